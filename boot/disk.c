@@ -0,0 +1,67 @@
+#include <inc/x86.h>
+
+/**********************************************************************
+ * IDE disk access shared by the boot sector (main.c) and the stage-2
+ * loader (loadmain.c).  Both run in protected mode with an identity
+ * segment mapping (see boot.S), so physical addresses can be used
+ * directly as pointers.
+ **********************************************************************/
+
+#define SECTSIZE	512
+#define MAXSECTS	256	// most sectors one READ SECTORS command moves
+
+void
+waitdisk(void)
+{
+	// wait for disk reaady
+	while ((inb(0x1F7) & 0xC0) != 0x40)
+		/* do nothing */;
+}
+
+// Issue a READ SECTORS command for 'nsect' (1 to MAXSECTS) sectors
+// starting at sector 'offset'.  The drive starts fetching them while
+// the caller goes on with other work; readsect_finish pulls the data.
+void
+readsect_start(uint32_t offset, uint32_t nsect)
+{
+	// wait for disk to be ready
+	waitdisk();
+
+	outb(0x1F2, nsect);	// count; 0 means 256
+	outb(0x1F3, offset);
+	outb(0x1F4, offset >> 8);
+	outb(0x1F5, offset >> 16);
+	outb(0x1F6, (offset >> 24) | 0xE0);
+	outb(0x1F7, 0x20);	// cmd 0x20 - read sectors
+}
+
+// Copy the 'nsect' sectors of the command readsect_start issued
+// into 'dst'.
+void
+readsect_finish(void *dst, uint32_t nsect)
+{
+	// The drive raises DRQ once per sector; wait for BSY to drop
+	// and DRQ to come up before pulling each one.
+	for (; nsect > 0; nsect--) {
+		while ((inb(0x1F7) & 0x88) != 0x08)
+			/* do nothing */;
+		insl(0x1F0, dst, SECTSIZE/4);
+		dst = (uint8_t *) dst + SECTSIZE;
+	}
+}
+
+// Read 'nsect' consecutive sectors starting at sector 'offset' into
+// 'dst', moving up to MAXSECTS of them per READ SECTORS command
+// instead of paying a full command round trip for each sector.
+void
+readsect(void *dst, uint32_t offset, uint32_t nsect)
+{
+	uint32_t n;
+
+	for (; nsect > 0; nsect -= n, offset += n) {
+		n = MIN(nsect, MAXSECTS);
+		readsect_start(offset, n);
+		readsect_finish(dst, n);
+		dst = (uint8_t *) dst + n * SECTSIZE;
+	}
+}
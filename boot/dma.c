@@ -0,0 +1,190 @@
+#include <inc/x86.h>
+
+/**********************************************************************
+ * Bus-master IDE DMA for the stage-2 loader.
+ *
+ * A PIIX-style IDE controller can move sectors straight into memory
+ * on its own, described by a table of physical regions (PRDs), instead
+ * of having the CPU pull every word out of the data port with insl.
+ * dma_init() looks for such a controller on PCI bus 0; if there is
+ * none, or a transfer fails, the diskread functions below fall back
+ * to the PIO routines in disk.c, so callers need not care which one
+ * is in use.
+ *
+ * Like the PIO path, these only talk to the first drive on the
+ * primary channel, at its legacy ports 0x1F0-0x1F7.
+ **********************************************************************/
+
+#define SECTSIZE	512
+#define MAXSECTS	256	// most sectors one READ DMA command moves
+
+// PCI configuration mechanism #1
+#define PCI_CONF_ADDR	0xCF8
+#define PCI_CONF_DATA	0xCFC
+#define PCI_COMMAND	0x04	// command register
+#define PCI_CLASS	0x08	// class, subclass, prog-if, revision
+#define PCI_BAR4	0x20	// bus-master IDE I/O base
+#define PCI_CMD_IO	0x1	// respond to I/O space accesses
+#define PCI_CMD_MASTER	0x4	// allow the device to master the bus
+
+// Bus-master IDE registers, primary channel, relative to BAR4
+#define BM_CMD		0
+#define BM_STATUS	2
+#define BM_PRDT		4
+#define BM_CMD_START	0x01
+#define BM_CMD_READ	0x08	// transfer from the drive to memory
+#define BM_STATUS_ACT	0x01	// transfer in progress
+#define BM_STATUS_ERR	0x02	// write 1 to clear
+#define BM_STATUS_IRQ	0x04	// write 1 to clear
+
+// A physical region descriptor.  A region may not cross a 64KB
+// boundary and a count of 0 means 64KB.
+struct Prd {
+	uint32_t prd_pa;
+	uint16_t prd_count;
+	uint16_t prd_flags;
+};
+#define PRD_EOT		0x8000	// last entry in the table
+#define PRDLIM		0x10000
+
+// MAXSECTS sectors span at most three 64KB-aligned regions.
+// The table must be 4-byte aligned and may not cross 64KB itself.
+static struct Prd prdt[3] __attribute__((aligned(32)));
+
+static uint32_t bmbase;		// bus-master I/O base, 0 if no DMA
+
+// The transfer diskread_start issued and diskread_finish completes.
+static void *pend_dst;
+static uint32_t pend_offset, pend_nsect;
+
+void waitdisk(void);
+void readsect(void*, uint32_t, uint32_t);
+void readsect_start(uint32_t, uint32_t);
+void readsect_finish(void*, uint32_t);
+
+static uint32_t
+pci_conf_read(uint32_t devfn, uint32_t off)
+{
+	outl(PCI_CONF_ADDR, 0x80000000 | (devfn << 8) | off);
+	return inl(PCI_CONF_DATA);
+}
+
+static void
+pci_conf_write(uint32_t devfn, uint32_t off, uint32_t v)
+{
+	outl(PCI_CONF_ADDR, 0x80000000 | (devfn << 8) | off);
+	outl(PCI_CONF_DATA, v);
+}
+
+// Look for a bus-master IDE controller whose primary channel sits at
+// the legacy ports, and turn on its bus mastering.  Returns 0 if DMA
+// can be used, -1 if not.
+int
+dma_init(void)
+{
+	uint32_t devfn, class, bar;
+
+	for (devfn = 0; devfn < 256; devfn++) {
+		// class 1 (storage), subclass 1 (IDE), prog-if bit 7 set
+		// (bus master) and bit 0 clear (primary in compat mode)
+		class = pci_conf_read(devfn, PCI_CLASS);
+		if ((class >> 16) != 0x0101 || (class & 0x8100) != 0x8000)
+			continue;
+		bar = pci_conf_read(devfn, PCI_BAR4);
+		if (!(bar & 1) || (bar & 0xFFFC) == 0)
+			continue;
+		pci_conf_write(devfn, PCI_COMMAND,
+			       pci_conf_read(devfn, PCI_COMMAND)
+			       | PCI_CMD_IO | PCI_CMD_MASTER);
+		bmbase = bar & 0xFFFC;
+		return 0;
+	}
+	return -1;
+}
+
+// Start moving 'nsect' (1 to MAXSECTS) sectors, beginning at sector
+// 'offset', into 'dst'.  The drive and controller do the work while
+// the caller goes on; diskread_finish waits for it to be done.
+void
+diskread_start(void *dst, uint32_t offset, uint32_t nsect)
+{
+	uint32_t pa, end, n;
+	struct Prd *prd;
+
+	pend_dst = dst;
+	pend_offset = offset;
+	pend_nsect = nsect;
+	if (!bmbase) {
+		readsect_start(offset, nsect);
+		return;
+	}
+
+	// describe [dst, dst + nsect*SECTSIZE), split at 64KB boundaries
+	pa = (uint32_t) dst;
+	end = pa + nsect * SECTSIZE;
+	for (prd = prdt; pa < end; prd++, pa += n) {
+		n = MIN(end - pa, PRDLIM - (pa & (PRDLIM - 1)));
+		prd->prd_pa = pa;
+		prd->prd_count = n & (PRDLIM - 1);
+		prd->prd_flags = 0;
+	}
+	prd[-1].prd_flags = PRD_EOT;
+
+	outb(bmbase + BM_CMD, 0);
+	outl(bmbase + BM_PRDT, (uint32_t) prdt);
+	outb(bmbase + BM_STATUS, BM_STATUS_ERR | BM_STATUS_IRQ);
+	outb(bmbase + BM_CMD, BM_CMD_READ);
+
+	waitdisk();
+	outb(0x1F2, nsect);	// count; 0 means 256
+	outb(0x1F3, offset);
+	outb(0x1F4, offset >> 8);
+	outb(0x1F5, offset >> 16);
+	outb(0x1F6, (offset >> 24) | 0xE0);
+	outb(0x1F7, 0xC8);	// cmd 0xC8 - read DMA
+
+	outb(bmbase + BM_CMD, BM_CMD_READ | BM_CMD_START);
+}
+
+// Wait for the transfer diskread_start issued to land in memory.
+// If the DMA transfer fails, DMA is given up on and the sectors
+// are read again with PIO.
+void
+diskread_finish(void)
+{
+	uint8_t status;
+
+	if (!bmbase) {
+		readsect_finish(pend_dst, pend_nsect);
+		return;
+	}
+
+	// The controller raises IRQ once the drive has signalled the
+	// end of the command (interrupts are off, so we just poll).
+	while (!((status = inb(bmbase + BM_STATUS))
+		 & (BM_STATUS_IRQ | BM_STATUS_ERR)))
+		/* do nothing */;
+	outb(bmbase + BM_CMD, 0);
+	outb(bmbase + BM_STATUS, BM_STATUS_ERR | BM_STATUS_IRQ);
+
+	// reading the drive's status also acknowledges its interrupt
+	if ((status & BM_STATUS_ERR) || (inb(0x1F7) & 0x21)) {
+		bmbase = 0;
+		readsect(pend_dst, pend_offset, pend_nsect);
+	}
+}
+
+// Read 'nsect' consecutive sectors starting at sector 'offset' into
+// 'dst', MAXSECTS at a time.
+void
+diskread(void *dst, uint32_t offset, uint32_t nsect)
+{
+	uint32_t n;
+
+	for (; nsect > 0; nsect -= n, offset += n) {
+		n = MIN(nsect, MAXSECTS);
+		diskread_start(dst, offset, n);
+		diskread_finish();
+		dst = (uint8_t *) dst + n * SECTSIZE;
+	}
+}
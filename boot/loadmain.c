@@ -0,0 +1,241 @@
+#include <inc/x86.h>
+#include <inc/elf.h>
+#include <inc/mmu.h>
+#include <inc/bootinfo.h>
+#include <inc/zimage.h>
+
+/**********************************************************************
+ * Stage-2 loader: reads the kernel image that follows the loader on
+ * disk into memory and jumps to it.  See main.c for the disk layout
+ * and the boot steps that lead here.
+ *
+ * The image is normally the compressed zimage built by mkzimage (see
+ * inc/zimage.h), but a plain ELF kernel is loaded just as well.
+ *
+ * Sectors are moved by bus-master DMA when the IDE controller supports
+ * it, and by PIO otherwise (see dma.c).  Building with BOOT_PIO defined
+ * ('make BOOTPIO=1') always uses PIO, for comparing the two.
+ **********************************************************************/
+
+#define SECTSIZE	512
+#define KERNSECT	(1 + LOADER_NSECT)	// first sector of the kernel
+#define HDRSIZE		(SECTSIZE*8)
+#define ELFHDR		((struct Elf *) 0x10000) // scratch space
+#define ZHDR		((struct Zhdr *) 0x10000) // same scratch page
+#define BI		((struct Bootinfo *) BOOTINFO)
+
+// Two staging buffers for compressed chunks, so one can be filled
+// while the other is decompressed.
+#define ZBUF(i)		((uint8_t *) 0x20000 + (i) * ZCHUNKSIZE)
+
+int dma_init(void);
+void diskread(void*, uint32_t, uint32_t);
+void diskread_start(void*, uint32_t, uint32_t);
+void diskread_finish(void);
+void readseg(uint32_t, uint32_t, uint32_t);
+void zeroseg(uint32_t, uint32_t);
+void lz4_decompress(void*, const void*, uint32_t);
+static uint32_t load_elf(void);
+static uint32_t load_zimage(void);
+static void stamp_load(void);
+
+void
+loadmain(void)
+{
+	uint32_t entry;
+
+	BI->bi_nload = 0;
+
+#ifndef BOOT_PIO
+	dma_init();
+#endif
+
+	// read 1st page off disk
+	readseg((uint32_t) ELFHDR, HDRSIZE, 0);
+
+	// is this a compressed image or a plain ELF?
+	if (ZHDR->zh_magic == ZIMAGE_MAGIC)
+		entry = load_zimage();
+	else if (ELFHDR->e_magic == ELF_MAGIC)
+		entry = load_elf();
+	else
+		goto bad;
+
+	// tell the kernel it need not clear its BSS again
+	BI->bi_magic = BOOTINFO_MAGIC;
+	BI->bi_flags = BI_BSS_ZEROED;
+	BI->bi_tsc[BT_KERNEL] = read_tsc();
+
+	// call the entry point from the image header
+	// note: does not return!
+	((void (*)(void)) entry)();
+
+bad:
+	outw(0x8A00, 0x8A00);
+	outw(0x8A00, 0x8E00);
+	while (1)
+		/* do nothing */;
+}
+
+// Load the segments of the plain ELF image whose first page is at
+// ELFHDR.  Returns the entry point.
+static uint32_t
+load_elf(void)
+{
+	struct Proghdr *ph, *eph;
+	uint32_t pa, end_pa, offset;
+
+	// load each program segment (ignores ph flags)
+	ph = (struct Proghdr *) ((uint8_t *) ELFHDR + ELFHDR->e_phoff);
+	eph = ph + ELFHDR->e_phnum;
+	while (ph < eph) {
+		// p_pa is the load address of this segment (as well
+		// as the physical address).  Segments that keep the same
+		// distance between file offset and load address, and that
+		// start within a page of the previous one, sit back to
+		// back on disk: merge them into one sequential read.
+		// Only the first p_filesz bytes of a segment are on disk.
+		pa = ph->p_pa;
+		offset = ph->p_offset;
+		end_pa = pa + ph->p_filesz;
+		for (ph++; ph < eph && ph->p_pa - ph->p_offset == pa - offset
+			     && ph->p_pa <= end_pa + PGSIZE; ph++)
+			end_pa = MAX(end_pa, ph->p_pa + ph->p_filesz);
+
+		// The first page of the image is already sitting at ELFHDR;
+		// copy whatever part of it this run covers rather than
+		// reading those sectors a second time.
+		for (; offset < HDRSIZE && pa < end_pa; pa++, offset++)
+			*(uint8_t *) pa = ((uint8_t *) ELFHDR)[offset];
+
+		readseg(pa, end_pa - pa, offset);
+		stamp_load();
+	}
+
+	// The rest of each segment, up to p_memsz, is its BSS.  Zero it
+	// only now that every read is done, since sector rounding and
+	// merged reads may have dropped file bytes there.
+	ph = (struct Proghdr *) ((uint8_t *) ELFHDR + ELFHDR->e_phoff);
+	for (; ph < eph; ph++)
+		if (ph->p_memsz > ph->p_filesz)
+			zeroseg(ph->p_pa + ph->p_filesz,
+				ph->p_memsz - ph->p_filesz);
+
+	return ELFHDR->e_entry;
+}
+
+// Number of sectors chunk 'zc' occupies on disk.
+#define ZCHUNK_NSECT(zc)	(((zc)->zc_zsize + SECTSIZE - 1) / SECTSIZE)
+
+// Where chunk 'zc' is read to: its load address if it is stored
+// uncompressed, staging buffer 'i' otherwise.
+#define ZCHUNK_BUF(zc, i) \
+	((zc)->zc_zsize == (zc)->zc_size ? (uint8_t *) (zc)->zc_pa : ZBUF(i))
+
+// Load the compressed image whose header page is at ZHDR.
+// Returns the entry point.
+static uint32_t
+load_zimage(void)
+{
+	struct Zseg *zs, *ezs;
+	struct Zchunk *zc, *ezc;
+	int i;
+
+	zs = (struct Zseg *) (ZHDR + 1);
+	ezs = zs + ZHDR->zh_nseg;
+	zc = (struct Zchunk *) ezs;
+	ezc = zc + ZHDR->zh_nchunk;
+
+	// Keep the disk one chunk ahead of the decompressor: once a
+	// chunk's sectors are in memory, ask for the next chunk before
+	// decompressing this one, so the drive seeks and fills its
+	// buffer meanwhile (with DMA, the transfer itself overlaps the
+	// decompression too).  A chunk stored uncompressed goes straight
+	// to its load address; others land in alternating staging
+	// buffers.  Reading whole sectors may spill past the end of a
+	// chunk, but chunks are loaded in increasing order and the
+	// staging buffers are never the load address of anything.
+	if (zc < ezc)
+		diskread_start(ZCHUNK_BUF(zc, 0), KERNSECT + zc->zc_sect,
+			       ZCHUNK_NSECT(zc));
+	for (i = 0; zc < ezc; zc++, i ^= 1) {
+		diskread_finish();
+
+		if (zc + 1 < ezc)
+			diskread_start(ZCHUNK_BUF(zc + 1, i ^ 1),
+				       KERNSECT + zc[1].zc_sect,
+				       ZCHUNK_NSECT(zc + 1));
+
+		if (zc->zc_zsize != zc->zc_size)
+			lz4_decompress((uint8_t *) zc->zc_pa, ZBUF(i),
+				       zc->zc_zsize);
+		stamp_load();
+	}
+
+	// zero each segment's BSS
+	for (; zs < ezs; zs++)
+		if (zs->zs_memsz > zs->zs_filesz)
+			zeroseg(zs->zs_pa + zs->zs_filesz,
+				zs->zs_memsz - zs->zs_filesz);
+
+	return ZHDR->zh_entry;
+}
+
+// Record when another load step (one read of a run of ELF segments,
+// or one zimage chunk) finished.
+static void
+stamp_load(void)
+{
+	if (BI->bi_nload < BI_NLOAD)
+		BI->bi_tload[BI->bi_nload] = read_tsc();
+	BI->bi_nload++;
+}
+
+// Read 'count' bytes at 'offset' from kernel into physical address 'pa'.
+// Might copy more than asked
+void
+readseg(uint32_t pa, uint32_t count, uint32_t offset)
+{
+	uint32_t end_pa;
+
+	if (count == 0)
+		return;
+	end_pa = pa + count;
+	
+	// round down to sector boundary
+	pa &= ~(SECTSIZE - 1);
+
+	// Translate from bytes to sectors, and read the whole range
+	// with as few commands as possible.  We'd write more to memory
+	// than asked, but it doesn't matter -- we load in increasing
+	// order.
+	//
+	// Since we haven't enabled paging yet and we're using
+	// an identity segment mapping (see boot.S), we can
+	// use physical addresses directly.  This won't be the
+	// case once JOS enables the MMU.
+	diskread((uint8_t*) pa, (offset / SECTSIZE) + KERNSECT,
+		 (end_pa - pa + SECTSIZE - 1) / SECTSIZE);
+}
+
+// Zero 'count' bytes at physical address 'pa'.  Most of the range is
+// cleared a word at a time; only the unaligned ends use byte stores.
+void
+zeroseg(uint32_t pa, uint32_t count)
+{
+	uint8_t *p;
+	uint32_t n;
+
+	p = (uint8_t *) pa;
+	for (; count > 0 && ((uint32_t) p & 3) != 0; count--)
+		*p++ = 0;
+
+	n = count / 4;
+	asm volatile("cld; rep stosl"
+		     : "+D" (p), "+c" (n)
+		     : "a" (0)
+		     : "cc", "memory");
+
+	for (count &= 3; count > 0; count--)
+		*p++ = 0;
+}
@@ -0,0 +1,53 @@
+#include <inc/types.h>
+
+/**********************************************************************
+ * LZ4 block decompression for the stage-2 loader.
+ *
+ * A block is a series of sequences: a token byte whose high nibble is
+ * a literal count and whose low nibble is a match length minus 4
+ * (15 in either means more length bytes follow, each added in until
+ * one is not 255), the literals themselves, and a 2-byte little-endian
+ * offset back into the output to copy the match from.  The last
+ * sequence stops after its literals.
+ **********************************************************************/
+
+// Decompress the 'zsize'-byte LZ4 block at 'src' into 'dst'.
+// The block was built by our own mkzimage, so it is trusted and
+// not bounds-checked.
+void
+lz4_decompress(void *dst, const void *src, uint32_t zsize)
+{
+	const uint8_t *s, *end, *m;
+	uint8_t *d;
+	uint32_t token, len;
+
+	d = dst;
+	s = src;
+	end = s + zsize;
+	while (s < end) {
+		token = *s++;
+
+		// literals
+		len = token >> 4;
+		if (len == 15)
+			do
+				len += *s;
+			while (*s++ == 255);
+		while (len-- > 0)
+			*d++ = *s++;
+		if (s >= end)
+			break;
+
+		// match; it may overlap the bytes it produces,
+		// so copy it a byte at a time
+		m = d - (s[0] | (s[1] << 8));
+		s += 2;
+		len = token & 15;
+		if (len == 15)
+			do
+				len += *s;
+			while (*s++ == 255);
+		for (len += 4; len > 0; len--)
+			*d++ = *m++;
+	}
+}
@@ -0,0 +1,217 @@
+/*
+ * mkzimage: build the compressed kernel image that the stage-2 loader
+ * (loadmain.c) reads.  See inc/zimage.h for the format.
+ *
+ * Usage: mkzimage <kernel ELF> <output image>
+ *
+ * This is a host program, built with the native compiler.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <inc/elf.h>
+#include <inc/zimage.h>
+
+#define SECTSIZE	512
+
+#define MINMATCH	4	// shortest match LZ4 can encode
+#define LASTLITERALS	5	// the last 5 bytes of a block are literals
+#define MFLIMIT		12	// no match starts in the last 12 bytes
+#define MAXOFFSET	65535	// farthest back a match can point
+#define HASHLOG		16
+
+static uint32_t hashtab[1 << HASHLOG];
+
+static void
+die(const char *msg, const char *arg)
+{
+	fprintf(stderr, "mkzimage: %s%s\n", msg, arg ? arg : "");
+	exit(1);
+}
+
+static uint32_t
+hash4(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, 4);
+	return (v * 2654435761U) >> (32 - HASHLOG);
+}
+
+// Emit the extra length bytes for a length field whose nibble
+// already holds 15; 'len' is what is left beyond that.
+static uint8_t *
+putlen(uint8_t *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+// Emit one sequence: the literals [anchor, anchor + nlit) followed,
+// unless 'mlen' is 0, by a match of 'mlen' bytes 'off' bytes back.
+static uint8_t *
+putseq(uint8_t *op, const uint8_t *anchor, size_t nlit, size_t off, size_t mlen)
+{
+	uint8_t *token;
+
+	token = op++;
+	*token = (nlit < 15 ? nlit : 15) << 4;
+	if (nlit >= 15)
+		op = putlen(op, nlit - 15);
+	memcpy(op, anchor, nlit);
+	op += nlit;
+	if (mlen == 0)
+		return op;
+
+	*op++ = off & 0xFF;
+	*op++ = off >> 8;
+	mlen -= MINMATCH;
+	*token |= mlen < 15 ? mlen : 15;
+	if (mlen >= 15)
+		op = putlen(op, mlen - 15);
+	return op;
+}
+
+// Greedy LZ4 block compression of 'n' bytes at 'src' into 'dst',
+// which must have room for n + n/255 + 16 bytes.
+// Returns the compressed size.
+static size_t
+lz4_compress(uint8_t *dst, const uint8_t *src, size_t n)
+{
+	const uint8_t *ip, *anchor, *match, *end;
+	uint8_t *op;
+	uint32_t h;
+	size_t mlen;
+
+	memset(hashtab, 0, sizeof(hashtab));
+	ip = anchor = src;
+	end = src + n;
+	op = dst;
+	while (n > MFLIMIT && ip < end - MFLIMIT) {
+		h = hash4(ip);
+		match = src + hashtab[h];
+		hashtab[h] = ip - src;
+		if (match >= ip || ip - match > MAXOFFSET
+		    || memcmp(match, ip, MINMATCH) != 0) {
+			ip++;
+			continue;
+		}
+
+		mlen = MINMATCH;
+		while (ip + mlen < end - LASTLITERALS && match[mlen] == ip[mlen])
+			mlen++;
+		op = putseq(op, anchor, ip - anchor, ip - match, mlen);
+		ip += mlen;
+		anchor = ip;
+	}
+	op = putseq(op, anchor, end - anchor, 0, 0);
+	return op - dst;
+}
+
+int
+main(int argc, char **argv)
+{
+	FILE *f;
+	uint8_t *elf, *img, *hdr, *zbuf;
+	long elfsize;
+	struct Elf *eh;
+	struct Proghdr *ph;
+	struct Zhdr *zh;
+	struct Zseg *zs;
+	struct Zchunk *zc;
+	uint32_t i, off, size, nsect;
+	size_t imgsize, zsize, total;
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: mkzimage <kernel> <zimage>\n");
+		exit(1);
+	}
+
+	if ((f = fopen(argv[1], "rb")) == NULL)
+		die("cannot open ", argv[1]);
+	fseek(f, 0, SEEK_END);
+	elfsize = ftell(f);
+	rewind(f);
+	if ((elf = malloc(elfsize)) == NULL
+	    || fread(elf, 1, elfsize, f) != (size_t) elfsize)
+		die("cannot read ", argv[1]);
+	fclose(f);
+
+	eh = (struct Elf *) elf;
+	if (elfsize < (long) sizeof(*eh) || eh->e_magic != ELF_MAGIC)
+		die("not an ELF file: ", argv[1]);
+
+	// The image can never be larger than the header page plus every
+	// chunk stored as is and padded out to a sector.
+	imgsize = ZHDRSIZE;
+	ph = (struct Proghdr *) (elf + eh->e_phoff);
+	for (i = 0; i < eh->e_phnum; i++)
+		if (ph[i].p_type == ELF_PROG_LOAD)
+			imgsize += ph[i].p_filesz
+				+ (ph[i].p_filesz / ZCHUNKSIZE + 1) * SECTSIZE;
+	if ((img = calloc(1, imgsize)) == NULL
+	    || (zbuf = malloc(ZCHUNKSIZE + ZCHUNKSIZE / 255 + 16)) == NULL)
+		die("out of memory", NULL);
+
+	hdr = img;
+	zh = (struct Zhdr *) hdr;
+	zh->zh_magic = ZIMAGE_MAGIC;
+	zh->zh_entry = eh->e_entry;
+	zs = (struct Zseg *) (zh + 1);
+	for (i = 0; i < eh->e_phnum; i++)
+		if (ph[i].p_type == ELF_PROG_LOAD && ph[i].p_memsz > 0) {
+			zs[zh->zh_nseg].zs_pa = ph[i].p_pa;
+			zs[zh->zh_nseg].zs_filesz = ph[i].p_filesz;
+			zs[zh->zh_nseg].zs_memsz = ph[i].p_memsz;
+			zh->zh_nseg++;
+		}
+
+	zc = (struct Zchunk *) (zs + zh->zh_nseg);
+	nsect = ZHDRSIZE / SECTSIZE;
+	total = 0;
+	for (i = 0; i < eh->e_phnum; i++) {
+		if (ph[i].p_type != ELF_PROG_LOAD)
+			continue;
+		if (ph[i].p_offset + ph[i].p_filesz > (uint32_t) elfsize)
+			die("segment runs past the end of ", argv[1]);
+		for (off = 0; off < ph[i].p_filesz; off += size) {
+			if ((uint8_t *) (zc + 1) > hdr + ZHDRSIZE)
+				die("too many chunks for the header page", NULL);
+			size = ph[i].p_filesz - off;
+			if (size > ZCHUNKSIZE)
+				size = ZCHUNKSIZE;
+
+			zsize = lz4_compress(zbuf, elf + ph[i].p_offset + off, size);
+			if (zsize < size)
+				memcpy(img + nsect * SECTSIZE, zbuf, zsize);
+			else {
+				zsize = size;
+				memcpy(img + nsect * SECTSIZE,
+				       elf + ph[i].p_offset + off, size);
+			}
+
+			zc->zc_pa = ph[i].p_pa + off;
+			zc->zc_size = size;
+			zc->zc_sect = nsect;
+			zc->zc_zsize = zsize;
+			zc++;
+			zh->zh_nchunk++;
+			nsect += (zsize + SECTSIZE - 1) / SECTSIZE;
+			total += size;
+		}
+	}
+
+	if ((f = fopen(argv[2], "wb")) == NULL)
+		die("cannot create ", argv[2]);
+	if (fwrite(img, SECTSIZE, nsect, f) != nsect || fclose(f) != 0)
+		die("cannot write ", argv[2]);
+
+	fprintf(stderr, "zimage is %u bytes, %lu bytes of segments in %u chunks\n",
+		nsect * SECTSIZE, (unsigned long) total, zh->zh_nchunk);
+	return 0;
+}
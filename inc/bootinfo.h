@@ -0,0 +1,84 @@
+#ifndef JOS_INC_BOOTINFO_H
+#define JOS_INC_BOOTINFO_H
+
+/*
+ * The boot loader hands information to the kernel in a struct Bootinfo
+ * at physical address BOOTINFO, in the otherwise unused conventional
+ * memory below the boot sector.  The kernel sees it at
+ * KERNBASE + BOOTINFO.  It is only valid if bi_magic is BOOTINFO_MAGIC;
+ * a kernel started some other way (e.g. through the multiboot header
+ * in entry.S) finds whatever happened to be in memory there.
+ */
+
+#define BOOTINFO	0x1000
+#define BOOTINFO_MAGIC	0x4A4F5342	// "BSOJ"
+
+// Values for Bootinfo::bi_flags
+#define BI_BSS_ZEROED	0x1	// loader zeroed [p_filesz, p_memsz) of each segment
+
+// Boot phases whose read_tsc() value is kept in Bootinfo::bi_tsc.
+// A slot stays 0 if its phase was never reached or recorded.
+#define BT_START	0	// boot sector entered, real mode
+#define BT_A20		1	// A20 enabled
+#define BT_PROT		2	// memory map read, protected mode on
+#define BT_LOADER	3	// stage-2 loader read in
+#define BT_KERNEL	4	// kernel loaded, jumping to its entry
+#define BT_PAGING	5	// entry.S: paging on
+#define BT_BSS		6	// i386_init: BSS cleared
+#define BT_CONS		7	// i386_init: console initialized
+#define BT_PROMPT	8	// first monitor prompt
+#define BT_NPHASE	9
+
+// Most load steps (merged ELF segment runs or zimage chunks) whose
+// completion time is kept in Bootinfo::bi_tload.
+#define BI_NLOAD	16
+
+// Most memory map entries kept in Bootinfo::bi_mmap
+#define BI_NMMAP	32
+
+// Offsets of fields in struct Bootinfo, and the address of a phase's
+// timestamp slot, for assembly code
+#define BI_MMAPCNT	12	// bi_nmmap
+#define BI_TSC		16	// bi_tsc
+#define BI_MMAP		216	// bi_mmap
+#define BI_TSCADDR(ph)	(BOOTINFO + BI_TSC + 8 * (ph))
+
+// Address range types in the memory map (INT 15h, E820)
+#define E820_RAM	1	// usable RAM
+#define E820_RESERVED	2	// in use or not to be used
+#define E820_ACPI	3	// ACPI tables, RAM once they are read
+#define E820_NVS	4	// ACPI non-volatile storage
+#define E820_BAD	5	// RAM found to be defective
+#define E820_SIZE	20	// bytes per entry
+
+#ifndef __ASSEMBLER__
+
+#include <inc/types.h>
+
+// One entry of the memory map, in the layout INT 15h, E820 returns.
+struct E820 {
+	uint64_t e820_addr;	// start of the range
+	uint64_t e820_len;	// length of the range in bytes
+	uint32_t e820_type;	// E820_* type
+} __attribute__((packed));
+
+struct Bootinfo {
+	uint32_t bi_magic;	// must equal BOOTINFO_MAGIC
+	uint32_t bi_flags;	// BI_* flags
+	uint32_t bi_nload;	// number of load steps, maybe > BI_NLOAD
+	uint32_t bi_nmmap;	// entries in bi_mmap; 0 if no map
+	uint64_t bi_tsc[BT_NPHASE];	// timestamp of each BT_* phase
+	uint64_t bi_tload[BI_NLOAD];	// when each load step finished
+	struct E820 bi_mmap[BI_NMMAP];	// physical memory map, BIOS order
+};
+
+#ifdef JOS_KERNEL
+// The kernel's own copy of the Bootinfo, taken in i386_init before
+// anything can reuse the low memory it sits in.  It is zero apart
+// from the kernel's phases if the boot loader left none.
+extern struct Bootinfo bootinfo;
+#endif
+
+#endif /* !__ASSEMBLER__ */
+
+#endif /* !JOS_INC_BOOTINFO_H */
@@ -39,19 +39,23 @@
  *                     |         Kernel Stack         | RW/--  KSTKSIZE   |
  *                     | - - - - - - - - - - - - - - -|                 PTSIZE
  *                     |      Invalid Memory (*)      | --/--             |
- *    ULIM     ------> +------------------------------+ 0xef800000      --+
+ *    MMIOLIM ------>  +------------------------------+ 0xef800000      --+
+ *                     |       Memory-mapped I/O      | RW/--  PTSIZE
+ * KMAPLIM,MMIOBASE -> +------------------------------+ 0xef400000
+ *                     |     Temporary mappings       | RW/--  PTSIZE
+ *  ULIM, KMAPBASE --> +------------------------------+ 0xef000000
  *                     |  Cur. Page Table (User R-)   | R-/R-  PTSIZE
- *    UVPT      ---->  +------------------------------+ 0xef400000
+ *    UVPT      ---->  +------------------------------+ 0xeec00000
  *                     |          RO PAGES            | R-/R-  PTSIZE
- *    UPAGES    ---->  +------------------------------+ 0xef000000
+ *    UPAGES    ---->  +------------------------------+ 0xee800000
  *                     |           RO ENVS            | R-/R-  PTSIZE
- * UTOP,UENVS ------>  +------------------------------+ 0xeec00000
+ * UTOP,UENVS ------>  +------------------------------+ 0xee400000
  * UXSTACKTOP -/       |     User Exception Stack     | RW/RW  PGSIZE
- *                     +------------------------------+ 0xeebff000
+ *                     +------------------------------+ 0xee3ff000
  *                     |       Empty Memory (*)       | --/--  PGSIZE
- *    USTACKTOP  --->  +------------------------------+ 0xeebfe000
+ *    USTACKTOP  --->  +------------------------------+ 0xee3fe000
  *                     |      Normal User Stack       | RW/RW  PGSIZE
- *                     +------------------------------+ 0xeebfd000
+ *                     +------------------------------+ 0xee3fd000
  *                     |                              |
  *                     |                              |
  *                     ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -71,6 +75,9 @@
  *                     |       Empty Memory (*)       |                   |
  *    0 ------------>  +------------------------------+                 --+
  *
+ * The addresses above are for two-level paging.  With PAE, PTSIZE is 2MB
+ * rather than 4MB, and VPT takes 8MB, so the regions below VPT move.
+ *
  * (*) Note: The kernel ensures that "Invalid Memory" (ULIM) is *never*
  *     mapped.  "Empty Memory" is normally unmapped, but user programs may
  *     map pages there if desired.  JOS user programs map pages temporarily
@@ -91,10 +98,24 @@
 // the page directory itself, thereby turning the PD into a page table,
 // which maps all the PTEs containing the page mappings for the entire
 // virtual address space into that 4 Meg region starting at VPT.
-#define VPT		(KERNBASE - PTSIZE)
+#ifdef JOS_PAE
+#define VPTSIZE		(NPDPENTRIES * PTSIZE)	// one PTSIZE per page directory
+#else
+#define VPTSIZE		PTSIZE
+#endif
+#define VPT		(KERNBASE - VPTSIZE)
 #define KSTACKTOP	VPT
 #define KSTKSIZE	(8*PGSIZE)   		// size of a kernel stack
-#define ULIM		(KSTACKTOP - PTSIZE) 
+
+// Memory-mapped IO: device memory, mapped with mmio_map_region()
+#define MMIOLIM		(KSTACKTOP - PTSIZE)
+#define MMIOBASE	(MMIOLIM - PTSIZE)
+
+// Temporary mappings of physical pages not mapped at KERNBASE (kmap())
+#define KMAPLIM		MMIOBASE
+#define KMAPBASE	(KMAPLIM - PTSIZE)
+
+#define ULIM		(KMAPBASE)
 
 /*
  * User read-only mappings! Anything below here til UTOP are readonly to user.
@@ -102,7 +123,7 @@
  */
 
 // Same as VPT but read-only for users
-#define UVPT		(ULIM - PTSIZE)
+#define UVPT		(ULIM - VPTSIZE)
 // Read-only copies of the Page structures
 #define UPAGES		(UVPT - PTSIZE)
 // Read-only copies of the global env structures
@@ -138,6 +159,8 @@
  * The page directory entry corresponding to the virtual address range
  * [VPT, VPT + PTSIZE) points to the page directory itself.  Thus, the page
  * directory is treated as a page table as well as a page directory.
+ * (With PAE, the four entries for [VPT, VPT + VPTSIZE) point to the four
+ * page directories, in order, and everything below works the same.)
  *
  * One result of treating the page directory as a page table is that all PTEs
  * can be accessed through a "virtual page table" at virtual address VPT (to
@@ -145,11 +168,16 @@
  * vpt[N].  (It's worth drawing a diagram of this!)
  *
  * A second consequence is that the contents of the current page directory
- * will always be available at virtual address (VPT + (VPT >> PGSHIFT)), to
- * which vpd is set in entry.S.
+ * will always be available at virtual address (VPT + VPN(VPT) * sizeof(pte_t)),
+ * to which vpd is set in entry.S.
  */
+#ifdef JOS_PAE
+typedef uint64_t pte_t;
+typedef uint64_t pde_t;
+#else
 typedef uint32_t pte_t;
 typedef uint32_t pde_t;
+#endif
 
 extern volatile pte_t vpt[];     // VA of "virtual page table"
 extern volatile pde_t vpd[];     // VA of current page directory
@@ -164,20 +192,34 @@ extern volatile pde_t vpd[];     // VA of current page directory
  * correspondence between physical pages and struct Page's.
  * You can map a Page * to the corresponding physical address
  * with page2pa() in kern/pmap.h.
+ *
+ * struct Page holds only what is looked at page after page, so that
+ * the array stays small and walking it touches little memory; the
+ * links for the free lists are kept apart (see kern/pmap.c).
  */
-LIST_HEAD(Page_list, Page);
-typedef LIST_ENTRY(Page) Page_LIST_entry_t;
-
 struct Page {
-	Page_LIST_entry_t pp_link;	/* free list link */
-
 	// pp_ref is the count of pointers (usually in page table entries)
 	// to this page, for pages allocated using page_alloc.
 	// Pages allocated at boot time using pmap.c's
 	// boot_alloc do not have valid reference count fields.
 
 	uint16_t pp_ref;
+
+	// Buddy allocator state (see kern/pmap.c).  A free page heads a
+	// free block of 2^pp_order pages, and has PP_FREE set; the other
+	// pages of the block are not looked at.  An allocated page keeps
+	// the order it was allocated with.
+	uint8_t pp_order;
+	uint8_t pp_flags;
 };
 
+// Values for Page::pp_flags
+#define PP_FREE		0x01	// heads a block on a free list
+#define PP_CACHED	0x02	// free, in a per-CPU page cache
+#define PP_ZERO		0x04	// free and zeroed, in the zero pool
+#define PP_COLOUR	0x08	// free, in a colour bucket
+// The bits above these hold the page's NUMA node (see kern/numa.h).
+#define PP_NODESHIFT	4
+
 #endif /* !__ASSEMBLER__ */
 #endif /* !JOS_INC_MEMLAYOUT_H */
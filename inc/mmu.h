@@ -22,20 +22,32 @@
 //  \--- PDX(la) --/ \--- PTX(la) --/ \---- PGOFF(la) ----/
 //  \----------- VPN(la) -----------/
 //
+// With PAE paging (JOS_PAE), entries are 64 bits, so a page directory or
+// page table holds 512 of them, and there are four page directories,
+// picked by the top two bits from a page directory pointer table:
+//
+// +2-+----9----+----9----+---------12----------+
+// |  | PD Idx  | PT Idx  | Offset within Page  |
+// +--+---------+---------+---------------------+
+//  \--PDX(la)-/ \-PTX(la)/ \---- PGOFF(la) ----/
+//
+// PDX then indexes the four directories laid end to end, as vpd[] shows
+// them, so the kernel mostly need not care which kind of paging it uses.
+//
 // The PDX, PTX, PGOFF, and VPN macros decompose linear addresses as shown.
 // To construct a linear address la from PDX(la), PTX(la), and PGOFF(la),
 // use PGADDR(PDX(la), PTX(la), PGOFF(la)).
 
 // page number field of address
-#define PPN(pa)		(((uintptr_t) (pa)) >> PTXSHIFT)
-#define VPN(la)		PPN(la)		// used to index into vpt[]
+#define PPN(pa)		((ppn_t) ((physaddr_t) (pa) >> PTXSHIFT))
+#define VPN(la)		(((uintptr_t) (la)) >> PTXSHIFT)	// used to index into vpt[]
 
 // page directory index
-#define PDX(la)		((((uintptr_t) (la)) >> PDXSHIFT) & 0x3FF)
+#define PDX(la)		((((uintptr_t) (la)) >> PDXSHIFT) & (NPDENTRIES - 1))
 #define VPD(la)		PDX(la)		// used to index into vpd[]
 
 // page table index
-#define PTX(la)		((((uintptr_t) (la)) >> PTXSHIFT) & 0x3FF)
+#define PTX(la)		((((uintptr_t) (la)) >> PTXSHIFT) & (NPTENTRIES - 1))
 
 // offset in page
 #define PGOFF(la)	(((uintptr_t) (la)) & 0xFFF)
@@ -44,17 +56,25 @@
 #define PGADDR(d, t, o)	((void*) ((d) << PDXSHIFT | (t) << PTXSHIFT | (o)))
 
 // Page directory and page table constants.
+#ifdef JOS_PAE
+#define NPDENTRIES	2048		// page directory entries, all four directories
+#define NPTENTRIES	512		// page table entries per page table
+#define NPDPENTRIES	4		// page directory pointers
+#define PTESHIFT	3		// log2(sizeof(pte_t))
+#else
 #define NPDENTRIES	1024		// page directory entries per page directory
 #define NPTENTRIES	1024		// page table entries per page table
+#define PTESHIFT	2		// log2(sizeof(pte_t))
+#endif
 
 #define PGSIZE		4096		// bytes mapped by a page
 #define PGSHIFT		12		// log2(PGSIZE)
 
 #define PTSIZE		(PGSIZE*NPTENTRIES) // bytes mapped by a page directory entry
-#define PTSHIFT		22		// log2(PTSIZE)
+#define PTSHIFT		(PGSHIFT + PGSHIFT - PTESHIFT)	// log2(PTSIZE)
 
 #define PTXSHIFT	12		// offset of PTX in a linear address
-#define PDXSHIFT	22		// offset of PDX in a linear address
+#define PDXSHIFT	PTSHIFT		// offset of PDX in a linear address
 
 // Page table/directory entry flags.
 #define PTE_P		0x001	// Present
@@ -66,6 +86,12 @@
 #define PTE_D		0x040	// Dirty
 #define PTE_PS		0x080	// Page Size
 #define PTE_G		0x100	// Global
+#define PTE_PAT		0x080	// Page Attribute Table index, in a 4KB page's PTE
+#ifdef JOS_PAE
+#define PTE_NX		0x8000000000000000ULL	// No Execute
+#else
+#define PTE_NX		0	// (there is no such bit without PAE)
+#endif
 
 // The PTE_AVAIL bits aren't used by the kernel or interpreted by the
 // hardware, so user processes are allowed to set them arbitrarily.
@@ -75,7 +101,11 @@
 #define PTE_ALLOWED	(PTE_AVAIL | PTE_P | PTE_W | PTE_U)
 
 // Address in page table or page directory entry
+#ifdef JOS_PAE
+#define PTE_ADDR(pte)	((physaddr_t) (pte) & 0x000FFFFFFFFFF000ULL)
+#else
 #define PTE_ADDR(pte)	((physaddr_t) (pte) & ~0xFFF)
+#endif
 
 // Control Register flags
 #define CR0_PE		0x00000001	// Protection Enable
@@ -91,6 +121,8 @@
 #define CR0_PG		0x80000000	// Paging
 
 #define CR4_PCE		0x00000100	// Performance counter enable
+#define CR4_PGE		0x00000080	// Page Global Enable
+#define CR4_PAE		0x00000020	// Physical Address Extension
 #define CR4_MCE		0x00000040	// Machine Check Enable
 #define CR4_PSE		0x00000010	// Page Size Extensions
 #define CR4_DE		0x00000008	// Debugging Extensions
@@ -98,6 +130,10 @@
 #define CR4_PVI		0x00000002	// Protected-Mode Virtual Interrupts
 #define CR4_VME		0x00000001	// V86 Mode Extensions
 
+// Extended feature enable register, MSR 0xC0000080
+#define MSR_EFER	0xC0000080
+#define EFER_NXE	0x00000800	// No-Execute Enable
+
 // Eflags register
 #define FL_CF		0x00000001	// Carry Flag
 #define FL_PF		0x00000004	// Parity Flag
@@ -0,0 +1,43 @@
+#ifndef JOS_INC_MULTIBOOT_H
+#define JOS_INC_MULTIBOOT_H
+
+#include <inc/types.h>
+
+/*
+ * What a multiboot loader (e.g. GRUB, or QEMU's -kernel) hands the
+ * kernel it starts through the header in kern/entry.S: this magic
+ * number in %eax, and the physical address of a struct Multiboot in
+ * %ebx.  Only the parts JOS uses are described here.
+ */
+
+#define MULTIBOOT_BOOTLOADER_MAGIC	0x2BADB002
+
+// Values for Multiboot::mb_flags, telling which fields are valid
+#define MULTIBOOT_INFO_MEMORY	0x001	// mb_mem_lower, mb_mem_upper
+#define MULTIBOOT_INFO_CMDLINE	0x004	// mb_cmdline
+#define MULTIBOOT_INFO_MMAP	0x040	// mb_mmap_length, mb_mmap_addr
+
+struct Multiboot {
+	uint32_t mb_flags;
+	uint32_t mb_mem_lower;		// KB of memory from 0
+	uint32_t mb_mem_upper;		// KB of memory from 1MB
+	uint32_t mb_boot_device;
+	uint32_t mb_cmdline;		// physical address of command line
+	uint32_t mb_mods_count;
+	uint32_t mb_mods_addr;
+	uint32_t mb_syms[4];
+	uint32_t mb_mmap_length;	// bytes of memory map
+	uint32_t mb_mmap_addr;		// physical address of memory map
+};
+
+// A memory map entry.  mm_size does not count itself, so the next
+// entry starts mm_size + 4 bytes further on.  mm_type takes the same
+// values as E820 (see inc/bootinfo.h).
+struct Multiboot_mmap {
+	uint32_t mm_size;
+	uint64_t mm_addr;
+	uint64_t mm_len;
+	uint32_t mm_type;
+} __attribute__((packed));
+
+#endif /* !JOS_INC_MULTIBOOT_H */
@@ -0,0 +1,212 @@
+#ifndef JOS_INC_POOL_H
+#define JOS_INC_POOL_H
+
+#include <inc/types.h>
+
+/*
+ * A pool hands out objects of one fixed-size type.  It is given memory
+ * in chunks, which it carves into objects once and never takes back,
+ * and keeps the free objects on a list linked through a field of the
+ * objects themselves (their POOL_ENTRY), so allocating or freeing is a
+ * handful of instructions and objects are never split or merged.
+ *
+ * A pool can also keep a short free list per CPU in front of the
+ * shared one, which a CPU then only goes to for a batch of objects at
+ * a time.  Pass ncpu = 0 to POOL_HEAD for a pool without them.
+ *
+ * Constructor and destructor hooks run on each object as it is
+ * allocated and freed; POOL_NOHOOK does nothing.  When the pool runs
+ * out, it calls its grow function, if it has one, for more memory.
+ *
+ * Every pool keeps a struct Poolstats, with its name and high-water
+ * mark, which the kernel monitor's "pools" command shows.
+ */
+
+/*
+ * An example using the below macros.
+ */
+#if 0
+
+struct Frob
+{
+	int frobozz;
+	POOL_ENTRY(Frob) frob_free;	/* link while on a free list */
+};
+
+POOL_HEAD(Frob_pool, Frob, NCPU);	/* defines struct Frob_pool */
+POOL_GENERATE(static, frobpool, Frob_pool, Frob, frob_free, cpunum(),
+	      frob_ctor, POOL_NOHOOK)	/* defines frobpool_alloc() etc. */
+
+struct Frob_pool fpool;
+struct Frob frobs[100];
+
+frobpool_init(&fpool, "frob", 0);	/* no grow function */
+frobpool_add(&fpool, frobs, sizeof(frobs)); /* 100 objects to hand out */
+
+struct Frob *f = frobpool_alloc(&fpool);	/* NULL if there are none */
+frobpool_free(&fpool, f);
+
+#endif
+
+/*
+ * Statistics kept by every pool.
+ */
+struct Poolstats {
+	const char *ps_name;
+	uint32_t ps_size;		/* bytes per object */
+	uint32_t ps_total;		/* objects given to the pool */
+	uint32_t ps_inuse;		/* objects allocated now */
+	uint32_t ps_hiwat;		/* most ever allocated at once */
+	uint32_t ps_nalloc;		/* successful allocations */
+	uint32_t ps_nfail;		/* allocations that found none */
+	struct Poolstats *ps_next;	/* next registered pool */
+};
+
+/*
+ * Per-CPU free lists hold up to POOL_CPUHIGH objects; one that runs
+ * empty takes POOL_CPUBATCH from the shared list, and one that
+ * overflows gives that many back.
+ */
+#define POOL_CPUHIGH	32
+#define POOL_CPUBATCH	16
+
+#define POOL_ENTRY(type)	struct type *
+
+#define POOL_HEAD(name, type, ncpu)					\
+struct name {								\
+	struct type *ph_free;		/* shared free list */		\
+	struct {							\
+		struct type *pc_free;	/* this CPU's free list */	\
+		uint32_t pc_count;	/* objects on pc_free */	\
+	} ph_cpu[ncpu];							\
+	void *(*ph_grow)(size_t *);	/* gets more memory */		\
+	struct Poolstats ph_stats;					\
+}
+
+#define POOL_NCPU(pool)	(sizeof((pool)->ph_cpu) / sizeof((pool)->ph_cpu[0]))
+
+#define POOL_NOHOOK(obj)	do { } while (0)
+
+/*
+ * Define the functions that work on pools of type 'struct name',
+ * prefixed with 'prefix' and declared with 'attr' (say, static).
+ * 'cpu' is an expression for the running CPU's number, 'ctor' and
+ * 'dtor' functions (or macros) taking a struct type *.
+ */
+#define POOL_GENERATE(attr, prefix, name, type, field, cpu, ctor, dtor)	\
+									\
+/* Set up an empty pool; 'grow', if not null, gets it more memory. */	\
+attr void								\
+prefix##_init(struct name *pool, const char *pname,			\
+	      void *(*grow)(size_t *))					\
+{									\
+	uint32_t __i;							\
+									\
+	pool->ph_free = NULL;						\
+	for (__i = 0; __i < POOL_NCPU(pool); __i++) {			\
+		pool->ph_cpu[__i].pc_free = NULL;			\
+		pool->ph_cpu[__i].pc_count = 0;				\
+	}								\
+	pool->ph_grow = grow;						\
+	pool->ph_stats.ps_name = pname;					\
+	pool->ph_stats.ps_size = sizeof(struct type);			\
+	pool->ph_stats.ps_total = pool->ph_stats.ps_inuse = 0;		\
+	pool->ph_stats.ps_hiwat = pool->ph_stats.ps_nalloc = 0;		\
+	pool->ph_stats.ps_nfail = 0;					\
+	pool->ph_stats.ps_next = NULL;					\
+}									\
+									\
+/* Carve [mem, mem+len) into objects for the pool. */			\
+attr void								\
+prefix##_add(struct name *pool, void *mem, size_t len)			\
+{									\
+	struct type *__o = mem;						\
+									\
+	for (; len >= sizeof(struct type); len -= sizeof(struct type)) {\
+		__o->field = pool->ph_free;				\
+		pool->ph_free = __o++;					\
+		pool->ph_stats.ps_total++;				\
+	}								\
+}									\
+									\
+/* Take an object off the shared list, growing the pool if need be. */	\
+static struct type *							\
+prefix##_take(struct name *pool)					\
+{									\
+	struct type *__o;						\
+	size_t __len;							\
+	void *__mem;							\
+									\
+	if (pool->ph_free == NULL && pool->ph_grow			\
+	    && (__mem = pool->ph_grow(&__len)) != NULL)			\
+		prefix##_add(pool, __mem, __len);			\
+	if ((__o = pool->ph_free) != NULL)				\
+		pool->ph_free = __o->field;				\
+	return __o;							\
+}									\
+									\
+/* Allocate an object, or return NULL if there are none left. */	\
+attr struct type *							\
+prefix##_alloc(struct name *pool)					\
+{									\
+	struct type *__o;						\
+	uint32_t __c, __n;						\
+									\
+	if (POOL_NCPU(pool) == 0) {					\
+		if ((__o = prefix##_take(pool)) == NULL)		\
+			goto fail;					\
+	} else {							\
+		__c = (cpu);						\
+		if (pool->ph_cpu[__c].pc_free == NULL)			\
+			for (__n = 0; __n < POOL_CPUBATCH		\
+			     && (__o = prefix##_take(pool)) != NULL;	\
+			     __n++) {					\
+				__o->field = pool->ph_cpu[__c].pc_free;	\
+				pool->ph_cpu[__c].pc_free = __o;	\
+				pool->ph_cpu[__c].pc_count++;		\
+			}						\
+		if ((__o = pool->ph_cpu[__c].pc_free) == NULL)		\
+			goto fail;					\
+		pool->ph_cpu[__c].pc_free = __o->field;			\
+		pool->ph_cpu[__c].pc_count--;				\
+	}								\
+	pool->ph_stats.ps_nalloc++;					\
+	if (++pool->ph_stats.ps_inuse > pool->ph_stats.ps_hiwat)	\
+		pool->ph_stats.ps_hiwat = pool->ph_stats.ps_inuse;	\
+	ctor(__o);							\
+	return __o;							\
+									\
+fail:									\
+	pool->ph_stats.ps_nfail++;					\
+	return NULL;							\
+}									\
+									\
+/* Give an object back to the pool. */					\
+attr void								\
+prefix##_free(struct name *pool, struct type *obj)			\
+{									\
+	struct type *__o;						\
+	uint32_t __c, __n;						\
+									\
+	dtor(obj);							\
+	pool->ph_stats.ps_inuse--;					\
+	if (POOL_NCPU(pool) == 0) {					\
+		obj->field = pool->ph_free;				\
+		pool->ph_free = obj;					\
+		return;							\
+	}								\
+	__c = (cpu);							\
+	obj->field = pool->ph_cpu[__c].pc_free;				\
+	pool->ph_cpu[__c].pc_free = obj;				\
+	if (++pool->ph_cpu[__c].pc_count <= POOL_CPUHIGH)		\
+		return;							\
+	for (__n = 0; __n < POOL_CPUBATCH; __n++) {			\
+		__o = pool->ph_cpu[__c].pc_free;			\
+		pool->ph_cpu[__c].pc_free = __o->field;			\
+		__o->field = pool->ph_free;				\
+		pool->ph_free = __o;					\
+	}								\
+	pool->ph_cpu[__c].pc_count -= POOL_CPUBATCH;			\
+}
+
+#endif	/* !JOS_INC_POOL_H */
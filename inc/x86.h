@@ -2,6 +2,7 @@
 #define JOS_INC_X86_H
 
 #include <inc/types.h>
+#include <inc/mmu.h>
 
 static __inline void breakpoint(void) __attribute__((always_inline));
 static __inline uint8_t inb(int port) __attribute__((always_inline));
@@ -28,12 +29,17 @@ static __inline uint32_t rcr3(void) __attribute__((always_inline));
 static __inline void lcr4(uint32_t val) __attribute__((always_inline));
 static __inline uint32_t rcr4(void) __attribute__((always_inline));
 static __inline void tlbflush(void) __attribute__((always_inline));
+static __inline void tlbflush_global(void) __attribute__((always_inline));
 static __inline uint32_t read_eflags(void) __attribute__((always_inline));
 static __inline void write_eflags(uint32_t eflags) __attribute__((always_inline));
 static __inline uint32_t read_ebp(void) __attribute__((always_inline));
 static __inline uint32_t read_esp(void) __attribute__((always_inline));
 static __inline void cpuid(uint32_t info, uint32_t *eaxp, uint32_t *ebxp, uint32_t *ecxp, uint32_t *edxp);
+static __inline void cpuid_count(uint32_t info, uint32_t count, uint32_t *eaxp, uint32_t *ebxp, uint32_t *ecxp, uint32_t *edxp);
 static __inline uint64_t read_tsc(void) __attribute__((always_inline));
+static __inline uint64_t rdmsr(uint32_t msr) __attribute__((always_inline));
+static __inline void wrmsr(uint32_t msr, uint64_t val) __attribute__((always_inline));
+static __inline void wbinvd(void) __attribute__((always_inline));
 
 static __inline void
 breakpoint(void)
@@ -219,6 +225,21 @@ tlbflush(void)
 	__asm __volatile("movl %0,%%cr3" : : "r" (cr3));
 }
 
+// Like tlbflush, but also drops global (PTE_G) translations, which
+// reloading %cr3 keeps.  Needed only when a global mapping changes.
+static __inline void
+tlbflush_global(void)
+{
+	uint32_t cr4;
+	__asm __volatile("movl %%cr4,%0" : "=r" (cr4));
+	if (cr4 & CR4_PGE) {
+		// clearing PGE flushes the whole TLB
+		__asm __volatile("movl %0,%%cr4" : : "r" (cr4 & ~CR4_PGE));
+		__asm __volatile("movl %0,%%cr4" : : "r" (cr4));
+	} else
+		tlbflush();
+}
+
 static __inline uint32_t
 read_eflags(void)
 {
@@ -266,6 +287,24 @@ cpuid(uint32_t info, uint32_t *eaxp, uint32_t *ebxp, uint32_t *ecxp, uint32_t *e
 		*edxp = edx;
 }
 
+// Like cpuid, for the leaves that take a subleaf number in %ecx
+static __inline void
+cpuid_count(uint32_t info, uint32_t count, uint32_t *eaxp, uint32_t *ebxp, uint32_t *ecxp, uint32_t *edxp)
+{
+	uint32_t eax, ebx, ecx, edx;
+	asm volatile("cpuid"
+		: "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+		: "a" (info), "c" (count));
+	if (eaxp)
+		*eaxp = eax;
+	if (ebxp)
+		*ebxp = ebx;
+	if (ecxp)
+		*ecxp = ecx;
+	if (edxp)
+		*edxp = edx;
+}
+
 static __inline uint64_t
 read_tsc(void)
 {
@@ -274,4 +313,25 @@ read_tsc(void)
         return tsc;
 }
 
+static __inline uint64_t
+rdmsr(uint32_t msr)
+{
+	uint64_t val;
+	__asm __volatile("rdmsr" : "=A" (val) : "c" (msr));
+	return val;
+}
+
+static __inline void
+wrmsr(uint32_t msr, uint64_t val)
+{
+	__asm __volatile("wrmsr" : : "c" (msr), "A" (val));
+}
+
+// Write back and invalidate all the caches
+static __inline void
+wbinvd(void)
+{
+	__asm __volatile("wbinvd" : : : "memory");
+}
+
 #endif /* !JOS_INC_X86_H */
@@ -0,0 +1,44 @@
+#ifndef JOS_INC_ZIMAGE_H
+#define JOS_INC_ZIMAGE_H
+
+/*
+ * Compressed kernel image, built from the kernel ELF by boot/mkzimage
+ * and loaded by the stage-2 loader (boot/loadmain.c).
+ *
+ * The first ZHDRSIZE bytes hold a struct Zhdr, followed by zh_nseg
+ * struct Zsegs and zh_nchunk struct Zchunks.  The file-backed part of
+ * each loadable segment is cut into chunks of at most ZCHUNKSIZE bytes,
+ * each compressed on its own as one LZ4 block (no frame header) and
+ * stored starting on a sector boundary, so the loader can read one
+ * chunk while it decompresses the one before.  A chunk that does not
+ * shrink is stored as is, with zc_zsize == zc_size.
+ *
+ * Like inc/elf.h, this header is shared with host tools and so does
+ * not include inc/types.h itself.
+ */
+
+#define ZIMAGE_MAGIC	0x5A534F4AU	/* "JOSZ" in little endian */
+#define ZHDRSIZE	4096		// header page, in bytes
+#define ZCHUNKSIZE	(64*1024)	// most bytes one chunk expands to
+
+struct Zhdr {
+	uint32_t zh_magic;	// must equal ZIMAGE_MAGIC
+	uint32_t zh_entry;	// kernel entry point (physical)
+	uint32_t zh_nseg;	// number of struct Zseg after the header
+	uint32_t zh_nchunk;	// number of struct Zchunk after those
+};
+
+struct Zseg {
+	uint32_t zs_pa;		// load address of the segment
+	uint32_t zs_filesz;	// bytes covered by chunks
+	uint32_t zs_memsz;	// bytes in memory; the rest is zeroed
+};
+
+struct Zchunk {
+	uint32_t zc_pa;		// where the chunk expands to
+	uint32_t zc_size;	// bytes it expands to
+	uint32_t zc_sect;	// first sector, counted from the image start
+	uint32_t zc_zsize;	// bytes stored on disk
+};
+
+#endif /* !JOS_INC_ZIMAGE_H */
@@ -0,0 +1,162 @@
+/* See COPYRIGHT for copyright information. */
+
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/string.h>
+#include <inc/stdio.h>
+#include <inc/assert.h>
+
+#include <kern/pmap.h>
+#include <kern/acpi.h>
+
+// Finding ACPI tables.
+//
+// The BIOS leaves the RSDP in low memory; it points to the RSDT (or,
+// from ACPI 2.0, the XSDT, with 64-bit pointers), which lists the
+// physical addresses of all the other tables.  These are read while
+// the kernel boots, before the page allocator is up, so tables that
+// are not mapped at KERNBASE are mapped with two large pages at
+// KMAPBASE, where nothing else is mapped until page_init().
+
+#define NACPITABLE	32
+
+static physaddr_t acpi_table[NACPITABLE];	// from the RSDT or XSDT
+static int nacpitable;
+static bool acpi_mapped;	// acpi_map() has pages at KMAPBASE
+
+static uint8_t
+acpi_sum(const void *p, size_t len)
+{
+	const uint8_t *b = p;
+	uint8_t sum = 0;
+
+	while (len-- > 0)
+		sum += *b++;
+	return sum;
+}
+
+// Return a kernel virtual address for the physical range [pa, pa+len),
+// which must be at most PTSIZE bytes long.  The address is good until
+// the next call or acpi_release().
+static void *
+acpi_map(physaddr_t pa, size_t len)
+{
+	physaddr_t base;
+
+	if (pa + len <= MAXKPA)
+		return (void *) (uintptr_t) (pa + KERNBASE);
+	static_assert(KMAPBASE + PTSIZE == KMAPLIM);
+	static_assert(KMAPBASE % PTSIZE == 0);
+	assert(len <= PTSIZE);
+
+	base = pa & ~(physaddr_t) (PTSIZE - 1);
+	vpd[PDX(KMAPBASE)] = base | PTE_P | PTE_PS;
+	vpd[PDX(KMAPBASE) + 1] = (base + PTSIZE) | PTE_P | PTE_PS;
+	invlpg((void *) KMAPBASE);
+	invlpg((void *) (KMAPBASE + PTSIZE));
+	acpi_mapped = 1;
+	return (void *) (KMAPBASE + (uintptr_t) (pa - base));
+}
+
+// Look for the RSDP in [pa, pa+len), on 16-byte boundaries.
+static struct Acpi_rsdp *
+rsdp_search(physaddr_t pa, size_t len)
+{
+	struct Acpi_rsdp *rsdp;
+	uint8_t *p;
+
+	for (p = (uint8_t *) KERNBASE + pa; len >= 20; p += 16, len -= 16) {
+		rsdp = (struct Acpi_rsdp *) p;
+		if (memcmp(rsdp->rsdp_sig, "RSD PTR ", 8) == 0
+		    && acpi_sum(rsdp, 20) == 0)
+			return rsdp;
+	}
+	return NULL;
+}
+
+// Find the RSDP and note where the tables it lists are.  Without ACPI
+// there are none, and acpi_find_table() finds nothing.
+void
+acpi_init(void)
+{
+	struct Acpi_rsdp *rsdp;
+	struct Acpi_hdr *sdt;
+	physaddr_t pa, ebda;
+	uint64_t table;
+	size_t esize;
+	uint8_t *p;
+	int i, n;
+
+	// The first KB of the EBDA, whose segment the BIOS data area
+	// holds at 0x40E, then the BIOS ROM.
+	ebda = *(uint16_t *) (KERNBASE + 0x40E) << 4;
+	rsdp = NULL;
+	if (ebda >= 0x80000 && ebda < IOPHYSMEM)
+		rsdp = rsdp_search(ebda, 1024);
+	if (rsdp == NULL)
+		rsdp = rsdp_search(0xE0000, 0x20000);
+	if (rsdp == NULL)
+		return;
+
+	// the XSDT if there is one we can address, otherwise the RSDT
+	if (rsdp->rsdp_rev >= 2 && rsdp->rsdp_xsdt != 0
+	    && (physaddr_t) rsdp->rsdp_xsdt == rsdp->rsdp_xsdt
+	    && acpi_sum(rsdp, rsdp->rsdp_len) == 0) {
+		pa = rsdp->rsdp_xsdt;
+		esize = 8;
+	} else {
+		pa = rsdp->rsdp_rsdt;
+		esize = 4;
+	}
+	sdt = acpi_map(pa, sizeof(*sdt));
+	if (sdt->ah_len <= PTSIZE)
+		sdt = acpi_map(pa, sdt->ah_len);
+	if (sdt->ah_len > PTSIZE || acpi_sum(sdt, sdt->ah_len) != 0) {
+		cprintf("ACPI: bad %s\n", esize == 8 ? "XSDT" : "RSDT");
+		acpi_release();
+		return;
+	}
+
+	n = (sdt->ah_len - sizeof(*sdt)) / esize;
+	p = (uint8_t *) (sdt + 1);
+	for (i = 0; i < n && nacpitable < NACPITABLE; i++, p += esize) {
+		table = esize == 8 ? *(uint64_t *) p : *(uint32_t *) p;
+		if ((physaddr_t) table == table)
+			acpi_table[nacpitable++] = table;
+	}
+	acpi_release();
+}
+
+// Return the first table with signature 'sig' whose checksum is right,
+// or NULL if there is none.  The table is only mapped until the next
+// call or acpi_release().
+struct Acpi_hdr *
+acpi_find_table(const char *sig)
+{
+	struct Acpi_hdr *h;
+	int i;
+
+	for (i = 0; i < nacpitable; i++) {
+		h = acpi_map(acpi_table[i], sizeof(*h));
+		if (memcmp(h->ah_sig, sig, 4) != 0 || h->ah_len > PTSIZE)
+			continue;
+		h = acpi_map(acpi_table[i], h->ah_len);
+		if (acpi_sum(h, h->ah_len) == 0)
+			return h;
+	}
+	return NULL;
+}
+
+// Undo the mappings acpi_map() made at KMAPBASE, which must be gone
+// before page_init().
+void
+acpi_release(void)
+{
+	if (!acpi_mapped)
+		return;
+	vpd[PDX(KMAPBASE)] = 0;
+	vpd[PDX(KMAPBASE) + 1] = 0;
+	invlpg((void *) KMAPBASE);
+	invlpg((void *) (KMAPBASE + PTSIZE));
+	acpi_mapped = 0;
+}
@@ -0,0 +1,42 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_ACPI_H
+#define JOS_KERN_ACPI_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// Root System Description Pointer, which the BIOS leaves in low memory
+struct Acpi_rsdp {
+	char rsdp_sig[8];		// "RSD PTR "
+	uint8_t rsdp_sum;		// checksum of the first 20 bytes
+	char rsdp_oem[6];
+	uint8_t rsdp_rev;		// 0 for ACPI 1.0, 2 for 2.0 and up
+	uint32_t rsdp_rsdt;		// physical address of the RSDT
+	// ACPI 2.0 and up
+	uint32_t rsdp_len;
+	uint64_t rsdp_xsdt;		// physical address of the XSDT
+	uint8_t rsdp_xsum;		// checksum of all of it
+	uint8_t rsdp_reserved[3];
+} __attribute__((packed));
+
+// The header every ACPI system description table starts with
+struct Acpi_hdr {
+	char ah_sig[4];			// which table, e.g. "SRAT"
+	uint32_t ah_len;		// bytes, header included
+	uint8_t ah_rev;
+	uint8_t ah_sum;			// all bytes add up to 0
+	char ah_oem[6];
+	char ah_oemtable[8];
+	uint32_t ah_oemrev;
+	uint32_t ah_creator;
+	uint32_t ah_creatorrev;
+} __attribute__((packed));
+
+void			acpi_init(void);
+struct Acpi_hdr		*acpi_find_table(const char *sig);
+void			acpi_release(void);
+
+#endif /* !JOS_KERN_ACPI_H */
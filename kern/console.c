@@ -5,11 +5,13 @@
 #include <inc/kbdreg.h>
 #include <inc/string.h>
 #include <inc/assert.h>
+#include <inc/error.h>
 
 #include <kern/console.h>
+#include <kern/pmap.h>
+#include <kern/pat.h>
 
 static void cons_intr(int (*proc)(void));
-static void cons_putc(int c);
 
 // Stupid I/O delay routine necessitated by historical PC design flaws
 static void
@@ -31,8 +33,14 @@ delay(void)
 #define COM_DLM		1	// Out: Divisor Latch High (DLAB=1)
 #define COM_IER		1	// Out: Interrupt Enable Register
 #define   COM_IER_RDI	0x01	//   Enable receiver data interrupt
+#define   COM_IER_TXI	0x02	//   Enable transmitter empty interrupt
 #define COM_IIR		2	// In:	Interrupt ID Register
+#define   COM_IIR_FIFO	0xC0	//   FIFOs enabled (both bits: 16550A)
 #define COM_FCR		2	// Out: FIFO Control Register
+#define   COM_FCR_ENABLE 0x01	//   Enable the FIFOs
+#define   COM_FCR_RCLR	0x02	//   Clear the receive FIFO
+#define   COM_FCR_XCLR	0x04	//   Clear the transmit FIFO
+#define   COM_FCR_TRIG8	0x80	//   Receive interrupt at 8 bytes
 #define COM_LCR		3	// Out: Line Control Register
 #define	  COM_LCR_DLAB	0x80	//   Divisor latch access bit
 #define	  COM_LCR_WLEN8	0x03	//   Wordlength: 8 bits
@@ -45,7 +53,37 @@ delay(void)
 #define   COM_LSR_TXRDY	0x20	//   Transmit buffer avail
 #define   COM_LSR_TSRE	0x40	//   Transmitter off
 
+#define COM_FREQ	115200	// Divisor latch value 1 gives this rate
+#define COM_FIFOSIZE	16	// Bytes in a 16550A transmit FIFO
+
+// The line rate; 'make BAUD=n' builds in another default, and a
+// multiboot command line can ask for another with "baud=n".
+#ifndef COM1_BAUD
+#define COM1_BAUD	COM_FREQ
+#endif
+
 static bool serial_exists;
+static uint32_t serial_baud;
+static int serial_txfifo;	// bytes the UART takes per empty transmitter
+
+// Output to the serial port goes through a ring, which the UART
+// drains as fast as the line allows, through its transmitter-empty
+// interrupt, while the kernel gets on with its work.  rpos and wpos
+// count bytes taken and added, and are not wrapped.
+#define SERTXSIZE 1024		// must be a power of 2
+
+static struct {
+	uint8_t buf[SERTXSIZE];
+	uint32_t rpos;
+	uint32_t wpos;
+} sertx;
+
+// Until the kernel is up, and once it panics, serial output is written
+// before serial_write returns, so none is lost if the machine dies.
+static bool serial_sync = 1;
+static uint8_t serial_ier;
+
+static void serial_tx(void);
 
 static int
 serial_proc_data(void)
@@ -58,41 +96,149 @@ serial_proc_data(void)
 void
 serial_intr(void)
 {
-	if (serial_exists)
+	if (serial_exists) {
 		cons_intr(serial_proc_data);
+		serial_tx();
+	}
+}
+
+// Interrupt when the transmitter can take more only while the ring
+// has more for it.
+static void
+serial_tx_intr(void)
+{
+	uint8_t ier = COM_IER_RDI;
+
+	if (sertx.rpos != sertx.wpos)
+		ier |= COM_IER_TXI;
+	if (ier != serial_ier)
+		outb(COM1+COM_IER, serial_ier = ier);
 }
 
+// Fill the empty transmitter (its FIFO, if it has one) from the ring.
 static void
-serial_putc(int c)
+serial_tx_fill(void)
+{
+	int n;
+
+	for (n = 0; n < serial_txfifo && sertx.rpos != sertx.wpos; n++)
+		outb(COM1+COM_TX, sertx.buf[sertx.rpos++ % SERTXSIZE]);
+}
+
+// Give the UART bytes from the ring for as long as it takes them,
+// without waiting for it.
+static void
+serial_tx(void)
+{
+	while (sertx.rpos != sertx.wpos
+	       && (inb(COM1+COM_LSR) & COM_LSR_TXRDY))
+		serial_tx_fill();
+	serial_tx_intr();
+}
+
+// Wait for the transmitter to empty, and fill it from the ring.
+static void
+serial_tx_wait(void)
 {
 	int i;
-	
+
 	for (i = 0;
 	     !(inb(COM1 + COM_LSR) & COM_LSR_TXRDY) && i < 12800;
 	     i++)
 		delay();
-	
-	outb(COM1 + COM_TX, c);
+
+	serial_tx_fill();
 }
 
 static void
-serial_init(void)
+serial_flush(void)
 {
-	// Turn off the FIFO
-	outb(COM1+COM_FCR, 0);
-	
+	while (sertx.rpos != sertx.wpos)
+		serial_tx_wait();
+	serial_tx_intr();
+}
+
+static void
+serial_write(const char *s, size_t n)
+{
+	if (!serial_exists)
+		return;
+
+	for (; n > 0; s++, n--) {
+		// A full ring only empties at line speed; make room the
+		// slow way.
+		if (sertx.wpos - sertx.rpos == SERTXSIZE)
+			serial_tx_wait();
+		sertx.buf[sertx.wpos++ % SERTXSIZE] = *s;
+	}
+
+	if (serial_sync)
+		serial_flush();
+	else
+		serial_tx();
+}
+
+// Set the line rate, once what was sent at the old one is out.
+// Only rates that divide COM_FREQ can be set exactly.
+int
+serial_setbaud(uint32_t baud)
+{
+	uint32_t div;
+	int i;
+
+	if (baud == 0 || COM_FREQ % baud != 0)
+		return -E_INVAL;
+	div = COM_FREQ / baud;
+
+	if (serial_exists) {
+		serial_flush();
+		for (i = 0;
+		     !(inb(COM1 + COM_LSR) & COM_LSR_TSRE) && i < 12800;
+		     i++)
+			delay();
+	}
+
 	// Set speed; requires DLAB latch
 	outb(COM1+COM_LCR, COM_LCR_DLAB);
-	outb(COM1+COM_DLL, (uint8_t) (115200 / 9600));
-	outb(COM1+COM_DLM, 0);
+	outb(COM1+COM_DLL, (uint8_t) div);
+	outb(COM1+COM_DLM, (uint8_t) (div >> 8));
 
 	// 8 data bits, 1 stop bit, parity off; turn off DLAB latch
 	outb(COM1+COM_LCR, COM_LCR_WLEN8 & ~COM_LCR_DLAB);
 
+	serial_baud = baud;
+	return 0;
+}
+
+void
+serial_status(uint32_t *baud, int *txfifo)
+{
+	*baud = serial_baud;
+	*txfifo = serial_txfifo;
+}
+
+static void
+serial_init(void)
+{
+	// Turn on the FIFOs, if it has them: then each time the
+	// transmitter empties, it takes a burst of bytes, not one.
+	outb(COM1+COM_FCR, COM_FCR_ENABLE | COM_FCR_RCLR | COM_FCR_XCLR
+	     | COM_FCR_TRIG8);
+	if ((inb(COM1+COM_IIR) & COM_IIR_FIFO) == COM_IIR_FIFO)
+		serial_txfifo = COM_FIFOSIZE;
+	else {
+		// an 8250 or 16450, or a 16550 with broken FIFOs
+		outb(COM1+COM_FCR, 0);
+		serial_txfifo = 1;
+	}
+
+	serial_setbaud(COM1_BAUD);
+
 	// No modem controls
 	outb(COM1+COM_MCR, 0);
-	// Enable rcv interrupts
-	outb(COM1+COM_IER, COM_IER_RDI);
+	// Enable rcv interrupts; xmit interrupts are enabled while there
+	// is output to send
+	outb(COM1+COM_IER, serial_ier = COM_IER_RDI);
 
 	// Clear any preexisting overrun indications and interrupts
 	// Serial port doesn't exist if COM_LSR returns 0xFF
@@ -120,6 +266,13 @@ lpt_putc(int c)
 	outb(0x378+2, 0x08);
 }
 
+static void
+lpt_write(const char *s, size_t n)
+{
+	for (; n > 0; s++, n--)
+		lpt_putc(*s);
+}
+
 
 
 
@@ -129,12 +282,42 @@ static unsigned addr_6845;
 static uint16_t *crt_buf;
 static uint16_t crt_pos;
 
+// Output is drawn in a shadow of the screen in RAM, and the rows that
+// changed are copied to crt_buf at the end of each batch: display
+// memory is slow to write and slower still to read, and a batch that
+// scrolls many times then reaches it only once.  The shadow is a ring
+// of lines, which also keeps the last CRT_HIST lines to scroll off the
+// top.  Counting lines since boot, line crt_top is on the top row.
+#define CRT_HIST	500		// lines of scrollback
+#define CRT_SHLINES	(CRT_HIST + CRT_ROWS)
+#define CRT_ALLROWS	((1 << CRT_ROWS) - 1)
+
+static uint16_t crt_shadow[CRT_SHLINES][CRT_COLS];
+static uint32_t crt_top;
+static uint32_t crt_back;	// lines scrolled back, to look at history
+static uint32_t crt_dirty;	// bit i set: row i differs from crt_buf
+
+// The 6845 shows the screen from crt_buf[crt_org] on, so scrolling is
+// done by moving crt_org down a line through the crt_vsize cells of
+// text memory, not by moving the text.  Only when it reaches the end
+// is the screen drawn again at the start.
+static uint32_t crt_org;
+static uint32_t crt_vsize;
+static uint32_t crt_shown;	// crt_org as last given to the 6845
+
+static uint16_t *
+cga_line(uint32_t line)
+{
+	return crt_shadow[line % CRT_SHLINES];
+}
+
 static void
 cga_init(void)
 {
 	volatile uint16_t *cp;
 	uint16_t was;
-	unsigned pos;
+	unsigned pos, org;
+	int row;
 
 	cp = (uint16_t*) (KERNBASE + CGA_BUF);
 	was = *cp;
@@ -153,24 +336,131 @@ cga_init(void)
 	outb(addr_6845, 15);
 	pos |= inb(addr_6845 + 1);
 
+	/* Extract where the screen starts in text memory */
+	outb(addr_6845, 12);
+	org = inb(addr_6845 + 1) << 8;
+	outb(addr_6845, 13);
+	org |= inb(addr_6845 + 1);
+
 	crt_buf = (uint16_t*) cp;
-	crt_pos = pos;
+	crt_vsize = (addr_6845 == CGA_BASE ? CRT_VRAM : MONO_VRAM)
+		/ sizeof(uint16_t);
+	if (org + CRT_SIZE > crt_vsize || pos < org)
+		org = pos = 0;
+	crt_org = crt_shown = org;
+	crt_pos = pos - org;
+
+	// Start the shadow with what the BIOS and boot loader left
+	for (row = 0; row < CRT_ROWS; row++)
+		memmove(cga_line(row), crt_buf + org + row * CRT_COLS,
+			CRT_COLS * sizeof(uint16_t));
 }
 
+// Once page tables can be built, move the text buffer to a mapping of
+// its own that is write-combining: the CPU then gathers character
+// writes and sends them to the card in bursts, where through the
+// KERNBASE mapping each one is a separate uncached store.  The whole
+// window is mapped, not just the page on screen.
+void
+cga_remap(void)
+{
+	physaddr_t pa = (uintptr_t) crt_buf - KERNBASE;
 
+	crt_buf = mmio_map_region(pa, CRT_VRAM, MT_WC);
+}
 
+// Copy the rows that changed to the screen, then show it from its new
+// start, and move the cursor.
 static void
-cga_putc(int c)
+cga_flush(void)
 {
-	// if no attribute given, then use black on white
-	if (!(c & ~0xFF))
-		c |= 0x0700;
+	uint32_t row;
+
+	for (row = 0; row < CRT_ROWS; row++)
+		if (crt_dirty & (1 << row))
+			memmove(crt_buf + crt_org + row * CRT_COLS,
+				cga_line(crt_top - crt_back + row),
+				CRT_COLS * sizeof(uint16_t));
+	crt_dirty = 0;
+
+	if (crt_org != crt_shown) {
+		outb(addr_6845, 12);
+		outb(addr_6845 + 1, crt_org >> 8);
+		outb(addr_6845, 13);
+		outb(addr_6845 + 1, crt_org);
+		crt_shown = crt_org;
+	}
+
+	/* move that little blinky thing, off the screen if looking back */
+	row = crt_org + (crt_back ? CRT_SIZE : crt_pos);
+	outb(addr_6845, 14);
+	outb(addr_6845 + 1, row >> 8);
+	outb(addr_6845, 15);
+	outb(addr_6845 + 1, row);
+}
 
-	switch (c & 0xff) {
+// Show the history 'n' lines further back, or forward if 'n' < 0.
+static void
+cga_view(int n)
+{
+	int back;
+
+	back = MAX((int) crt_back + n, 0);
+	back = MIN(back, (int) MIN(crt_top, CRT_HIST));
+	if (back != crt_back) {
+		crt_back = back;
+		crt_dirty = CRT_ALLROWS;
+		cga_flush();
+	}
+}
+
+// Store a character at the cursor.
+static void
+cga_set(uint16_t c)
+{
+	cga_line(crt_top + crt_pos / CRT_COLS)[crt_pos % CRT_COLS] = c;
+	crt_dirty |= 1 << (crt_pos / CRT_COLS);
+}
+
+// Scroll up a line if the cursor has gone past the bottom.  The screen
+// moves down a line in text memory, where each row but the new bottom
+// one is already drawn; nothing is written until the batch ends.
+static void
+cga_scroll(void)
+{
+	uint16_t *p;
+	int i;
+
+	if (crt_pos >= CRT_SIZE) {
+		crt_top++;
+		p = cga_line(crt_top + CRT_ROWS - 1);
+		for (i = 0; i < CRT_COLS; i++)
+			p[i] = 0x0700 | ' ';
+		crt_pos -= CRT_COLS;
+
+		crt_org += CRT_COLS;
+		if (crt_org + CRT_SIZE <= crt_vsize)
+			crt_dirty = (crt_dirty >> 1) | (1 << (CRT_ROWS - 1));
+		else {
+			// out of text memory: start again at the top
+			crt_org = 0;
+			crt_dirty = CRT_ALLROWS;
+		}
+	}
+}
+
+// Act on a character that is not simply written to the screen;
+// blanks get attribute 'attr'.
+static void
+cga_ctl(int c, uint16_t attr)
+{
+	int i;
+
+	switch (c) {
 	case '\b':
 		if (crt_pos > 0) {
 			crt_pos--;
-			crt_buf[crt_pos] = (c & ~0xff) | ' ';
+			cga_set(attr | ' ');
 		}
 		break;
 	case '\n':
@@ -180,32 +470,56 @@ cga_putc(int c)
 		crt_pos -= (crt_pos % CRT_COLS);
 		break;
 	case '\t':
-		cons_putc(' ');
-		cons_putc(' ');
-		cons_putc(' ');
-		cons_putc(' ');
-		cons_putc(' ');
-		break;
-	default:
-		crt_buf[crt_pos++] = c;		/* write the character */
+		for (i = 0; i < 5; i++) {
+			cga_set(attr | ' ');
+			crt_pos++;
+			cga_scroll();
+		}
 		break;
 	}
+}
 
-	// What is the purpose of this?
-	if (crt_pos >= CRT_SIZE) {
-		int i;
+static bool
+cga_isctl(char c)
+{
+	return c == '\b' || c == '\n' || c == '\r' || c == '\t';
+}
 
-		memmove(crt_buf, crt_buf + CRT_COLS, (CRT_SIZE - CRT_COLS) * sizeof(uint16_t));
-		for (i = CRT_SIZE - CRT_COLS; i < CRT_SIZE; i++)
-			crt_buf[i] = 0x0700 | ' ';
-		crt_pos -= CRT_COLS;
+// Write 'n' characters with CGA attribute 'attr' (in bits 8-15).
+// Runs of ordinary characters are stored straight into the shadow
+// line, and the screen and the 6845's cursor are updated once, at the
+// end, rather than after every character.
+static void
+cga_write(const char *s, size_t n, uint16_t attr)
+{
+	uint16_t *p;
+	uint32_t row;
+	size_t run;
+
+	// Output brings the display back from the history
+	if (crt_back) {
+		crt_back = 0;
+		crt_dirty = CRT_ALLROWS;
 	}
 
-	/* move that little blinky thing */
-	outb(addr_6845, 14);
-	outb(addr_6845 + 1, crt_pos >> 8);
-	outb(addr_6845, 15);
-	outb(addr_6845 + 1, crt_pos);
+	while (n > 0) {
+		row = crt_pos / CRT_COLS;
+		p = cga_line(crt_top + row);
+		for (run = 0; run < n && !cga_isctl(s[run])
+			     && crt_pos < (row + 1) * CRT_COLS; run++)
+			p[crt_pos++ % CRT_COLS] = attr | (uint8_t) s[run];
+		if (run > 0)
+			crt_dirty |= 1 << row;
+		else {
+			cga_ctl(s[0], attr);
+			run = 1;
+		}
+		cga_scroll();
+		s += run;
+		n -= run;
+	}
+
+	cga_flush();
 }
 
 
@@ -351,6 +665,12 @@ kbd_proc_data(void)
 	}
 
 	// Process special keys
+	// Shift-PgUp, Shift-PgDn: page through the display's history
+	if ((shift & SHIFT) && (c == KEY_PGUP || c == KEY_PGDN)) {
+		cga_view(c == KEY_PGUP ? CRT_ROWS / 2 : -CRT_ROWS / 2);
+		return 0;
+	}
+
 	// Ctrl-Alt-Del: reboot
 	if (!(~shift & (CTL | ALT)) && c == KEY_DEL) {
 		cprintf("Rebooting!\n");
@@ -424,13 +744,14 @@ cons_getc(void)
 	return 0;
 }
 
-// output a character to the console
-static void
-cons_putc(int c)
+// output 'n' characters to the console, each device taking them all
+// at once; black on white on the display
+void
+cons_write(const char *s, size_t n)
 {
-	serial_putc(c);
-	lpt_putc(c);
-	cga_putc(c);
+	serial_write(s, n);
+	lpt_write(s, n);
+	cga_write(s, n, 0x0700);
 }
 
 // initialize the console devices
@@ -445,13 +766,29 @@ cons_init(void)
 		cprintf("Serial port does not exist!\n");
 }
 
+// Choose whether serial output is written out before cputchar returns
+// ('sync'), or left for the UART to take from its ring.  Going
+// synchronous first sends everything still in the ring.
+void
+cons_sync(bool sync)
+{
+	serial_sync = sync;
+	if (sync && serial_exists)
+		serial_flush();
+}
+
 
 // `High'-level console I/O.  Used by readline and cprintf.
 
 void
 cputchar(int c)
 {
-	cons_putc(c);
+	char ch = c;
+
+	// the display honours an attribute in bits 8-15, if one is given
+	serial_write(&ch, 1);
+	lpt_write(&ch, 1);
+	cga_write(&ch, 1, (c & ~0xFF) ? (c & 0xFF00) : 0x0700);
 }
 
 int
@@ -459,8 +796,10 @@ getchar(void)
 {
 	int c;
 
+	// Nothing else runs while we wait for a key, so get ahead
+	// on zeroing pages.
 	while ((c = cons_getc()) == 0)
-		/* do nothing */;
+		page_zero_idle();
 	return c;
 }
 
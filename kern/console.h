@@ -16,9 +16,16 @@
 #define CRT_ROWS	25
 #define CRT_COLS	80
 #define CRT_SIZE	(CRT_ROWS * CRT_COLS)
+#define CRT_VRAM	0x8000		// bytes of text memory at CGA_BUF or MONO_BUF
+#define MONO_VRAM	0x1000		// bytes a monochrome adapter may really have
 
 void cons_init(void);
+void cga_remap(void);
 int cons_getc(void);
+void cons_write(const char *s, size_t n);
+void cons_sync(bool sync);
+int serial_setbaud(uint32_t baud);
+void serial_status(uint32_t *baud, int *txfifo);
 
 void kbd_intr(void); // irq 1
 void serial_intr(void); // irq 4
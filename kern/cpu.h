@@ -0,0 +1,23 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_CPU_H
+#define JOS_KERN_CPU_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// Maximum number of CPUs
+#define NCPU	8
+
+// The CPU this code is running on, from 0 to NCPU-1.  JOS brings up
+// only the boot CPU so far; once others run, this reads the local
+// APIC ID.
+static inline int
+cpunum(void)
+{
+	return 0;
+}
+
+#endif /* !JOS_KERN_CPU_H */
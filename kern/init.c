@@ -3,9 +3,19 @@
 #include <inc/stdio.h>
 #include <inc/string.h>
 #include <inc/assert.h>
+#include <inc/x86.h>
+#include <inc/memlayout.h>
+#include <inc/bootinfo.h>
+#include <inc/multiboot.h>
 
 #include <kern/monitor.h>
 #include <kern/console.h>
+#include <kern/pmap.h>
+#include <kern/pat.h>
+#include <kern/acpi.h>
+#include <kern/numa.h>
+
+struct Bootinfo bootinfo;
 
 // Test the stack backtrace function (lab 1 only)
 void
@@ -19,22 +29,125 @@ test_backtrace(int x)
 	cprintf("leaving test_backtrace %d\n", x);
 }
 
+// entry_pgdir maps physical [0, MB_MAPPED) at KERNBASE, so a multiboot
+// loader's structures can only be read if they lie below that.
+#define MB_MAPPED	(256 << 20)
+#define MB_KADDR(pa)	((void *) (KERNBASE + (pa)))
+
+// Copy the memory map a multiboot loader left at 'mbinfo' into bootinfo,
+// in the E820 form our own boot loader passes it in.
+static void
+multiboot_mmap(uint32_t mbinfo)
+{
+	struct Multiboot *mb;
+	struct Multiboot_mmap *mm;
+	uint32_t pa, end;
+	struct E820 *e;
+
+	if (mbinfo + sizeof(*mb) > MB_MAPPED)
+		return;
+	mb = MB_KADDR(mbinfo);
+
+	if ((mb->mb_flags & MULTIBOOT_INFO_MMAP)
+	    && mb->mb_mmap_addr + mb->mb_mmap_length <= MB_MAPPED) {
+		pa = mb->mb_mmap_addr;
+		end = pa + mb->mb_mmap_length;
+		for (; pa < end && bootinfo.bi_nmmap < BI_NMMAP;
+		     pa += mm->mm_size + 4) {
+			mm = MB_KADDR(pa);
+			e = &bootinfo.bi_mmap[bootinfo.bi_nmmap++];
+			e->e820_addr = mm->mm_addr;
+			e->e820_len = mm->mm_len;
+			e->e820_type = mm->mm_type;
+		}
+	} else if (mb->mb_flags & MULTIBOOT_INFO_MEMORY) {
+		// only the sizes of base and extended memory
+		e = bootinfo.bi_mmap;
+		e[0].e820_addr = 0;
+		e[0].e820_len = mb->mb_mem_lower * 1024ULL;
+		e[0].e820_type = E820_RAM;
+		e[1].e820_addr = EXTPHYSMEM;
+		e[1].e820_len = mb->mb_mem_upper * 1024ULL;
+		e[1].e820_type = E820_RAM;
+		bootinfo.bi_nmmap = 2;
+	}
+}
+
+// Act on the options in a multiboot loader's command line.  There is
+// only "baud=n", for the serial console's line rate.
+static void
+multiboot_cmdline(uint32_t mbinfo)
+{
+	struct Multiboot *mb;
+	uint32_t pa;
+	const char *s;
+
+	if (mbinfo + sizeof(*mb) > MB_MAPPED)
+		return;
+	mb = MB_KADDR(mbinfo);
+	if (!(mb->mb_flags & MULTIBOOT_INFO_CMDLINE))
+		return;
+
+	for (pa = mb->mb_cmdline; pa < MB_MAPPED - 5; pa++) {
+		s = MB_KADDR(pa);
+		if (*s == '\0')
+			break;
+		if ((pa == mb->mb_cmdline || s[-1] == ' ')
+		    && strncmp(s, "baud=", 5) == 0
+		    && serial_setbaud(strtol(s + 5, 0, 10)) < 0)
+			cprintf("baud=: unsupported rate\n");
+	}
+}
+
+// 'mbmagic' and 'mbinfo' are what a multiboot loader left in %eax and
+// %ebx (see entry.S); they mean nothing if our own boot loader ran.
 void
-i386_init(void)
+i386_init(uint32_t mbmagic, uint32_t mbinfo)
 {
 	extern char edata[], end[];
+	struct Bootinfo *bi = (struct Bootinfo *) (KERNBASE + BOOTINFO);
 
 	// Before doing anything else, complete the ELF loading process.
-	// Clear the uninitialized global data (BSS) section of our program.
+	// Clear the uninitialized global data (BSS) section of our program,
+	// unless the boot loader tells us it already did.
 	// This ensures that all static/global variables start out zero.
-	memset(edata, 0, end - edata);
+	if (bi->bi_magic != BOOTINFO_MAGIC || !(bi->bi_flags & BI_BSS_ZEROED))
+		memset(edata, 0, end - edata);
+
+	// Keep what the boot loader left before low memory is reused.
+	if (bi->bi_magic == BOOTINFO_MAGIC)
+		bootinfo = *bi;
+	else if (mbmagic == MULTIBOOT_BOOTLOADER_MAGIC)
+		multiboot_mmap(mbinfo);
+	bootinfo.bi_tsc[BT_BSS] = read_tsc();
 
 	// Initialize the console.
 	// Can't call cprintf until after we do this!
 	cons_init();
+	if (bi->bi_magic != BOOTINFO_MAGIC
+	    && mbmagic == MULTIBOOT_BOOTLOADER_MAGIC)
+		multiboot_cmdline(mbinfo);
+	bootinfo.bi_tsc[BT_CONS] = read_tsc();
 
 	cprintf("6828 decimal is %o octal!\n", 6828);
 
+	// Find out how much memory the machine has and where it is,
+	// and which NUMA node each part is on, and put it under the
+	// page allocator.
+	i386_detect_memory();
+	acpi_init();
+	numa_init();
+	page_init();
+
+	// Set up memory types, then give the display a write-combining
+	// mapping.
+	pat_init();
+	cga_remap();
+
+	// The kernel is up, so serial output no longer has to be
+	// written out before cprintf returns.
+	cons_sync(0);
+
 	// Test the stack backtrace function (lab 1 only)
 	test_backtrace(5);
 
@@ -66,6 +179,12 @@ _panic(const char *file, int line, const char *fmt,...)
 	// Be extra sure that the machine is in as reasonable state
 	__asm __volatile("cli; cld");
 
+	// Waiting for a key in the monitor must no longer zero pages
+	page_zero_stop();
+
+	// Get out what is queued, and the message, before going on
+	cons_sync(1);
+
 	va_start(ap, fmt);
 	cprintf("kernel panic at %s:%d: ", file, line);
 	vcprintf(fmt, ap);
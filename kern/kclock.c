@@ -0,0 +1,61 @@
+/* See COPYRIGHT for copyright information. */
+
+#include <inc/x86.h>
+
+#include <kern/kclock.h>
+
+unsigned
+mc146818_read(unsigned reg)
+{
+	outb(IO_RTC, reg);
+	return inb(IO_RTC+1);
+}
+
+void
+mc146818_write(unsigned reg, unsigned datum)
+{
+	outb(IO_RTC, reg);
+	outb(IO_RTC+1, datum);
+}
+
+
+// Time stamp counter calibration against the PIT.
+//
+// Counter 2 of the PIT runs off a fixed 1.193182MHz clock and its
+// output can be read back through port B, without any interrupts, so
+// timing one run of it down from a known count tells how many TSC
+// cycles go by in that many milliseconds.
+
+#define CALIBRATE_MS	50
+
+// Return the TSC frequency in kHz (cycles per millisecond).
+// The first call measures it, which takes CALIBRATE_MS.
+uint64_t
+tsc_khz(void)
+{
+	static uint64_t khz;
+	uint32_t latch;
+	uint64_t t0, t1;
+
+	if (khz)
+		return khz;
+
+	// gate counter 2 on, with the speaker off
+	outb(PPI_PORTB, (inb(PPI_PORTB) & ~PPI_SPKR) | PPI_T2GATE);
+
+	// in mode 0, the output goes high once the count reaches zero
+	latch = TIMER_FREQ * CALIBRATE_MS / 1000;
+	outb(TIMER_MODE, TIMER_SEL2 | TIMER_16BIT | TIMER_INTTC);
+	outb(TIMER_CNTR2, latch & 0xff);
+	outb(TIMER_CNTR2, latch >> 8);
+
+	t0 = read_tsc();
+	while (!(inb(PPI_PORTB) & PPI_T2OUT))
+		/* do nothing */;
+	t1 = read_tsc();
+
+	khz = (t1 - t0) / CALIBRATE_MS;
+	if (khz == 0)
+		khz = 1;
+	return khz;
+}
@@ -0,0 +1,48 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_KCLOCK_H
+#define JOS_KERN_KCLOCK_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// The 8253/8254 programmable interval timer
+#define IO_TIMER1	0x040		// 8253 Timer #1
+#define TIMER_FREQ	1193182		// input clock, in Hz
+#define TIMER_CNTR2	(IO_TIMER1 + 2)	// timer counter 2 port
+#define TIMER_MODE	(IO_TIMER1 + 3)	// timer mode port
+#define TIMER_SEL2	0x80		// select counter 2
+#define TIMER_INTTC	0x00		// mode 0, interrupt on terminal count
+#define TIMER_16BIT	0x30		// r/w counter 16 bits, LSB first
+
+// The PC's port B, which gates timer counter 2 and reports its output
+#define PPI_PORTB	0x061
+#define PPI_T2GATE	0x01		// counter 2 gate
+#define PPI_SPKR	0x02		// speaker data, driven by counter 2
+#define PPI_T2OUT	0x20		// counter 2 output
+
+#define	IO_RTC		0x070		// RTC port
+
+#define	MC_NVRAM_START	0xe	// start of NVRAM: offset 14
+#define	MC_NVRAM_SIZE	50	// 50 bytes of NVRAM
+
+// NVRAM bytes 7 & 8: base memory size
+#define NVRAM_BASELO	(MC_NVRAM_START + 7)	// low byte; RTC off. 0x15
+#define NVRAM_BASEHI	(MC_NVRAM_START + 8)	// high byte; RTC off. 0x16
+
+// NVRAM bytes 9 & 10: extended memory size, in KB, up to 64MB
+#define NVRAM_EXTLO	(MC_NVRAM_START + 9)	// low byte; RTC off. 0x17
+#define NVRAM_EXTHI	(MC_NVRAM_START + 10)	// high byte; RTC off. 0x18
+
+// NVRAM bytes 38 & 39: memory above 16MB, in 64KB units
+#define NVRAM_EXT16LO	(MC_NVRAM_START + 38)	// low byte; RTC off. 0x34
+#define NVRAM_EXT16HI	(MC_NVRAM_START + 39)	// high byte; RTC off. 0x35
+
+unsigned mc146818_read(unsigned reg);
+void mc146818_write(unsigned reg, unsigned datum);
+
+uint64_t tsc_khz(void);
+
+#endif	// !JOS_KERN_KCLOCK_H
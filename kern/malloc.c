@@ -0,0 +1,165 @@
+/* See COPYRIGHT for copyright information. */
+
+#include <inc/types.h>
+#include <inc/mmu.h>
+#include <inc/string.h>
+#include <inc/assert.h>
+#include <inc/malloc.h>
+
+#include <kern/pmap.h>
+#include <kern/malloc.h>
+
+// Kernel malloc() and free(), by way of a slab allocator.
+//
+// Small requests are rounded up to one of a fixed set of size classes.
+// Each class carves its objects out of slabs: single pages taken from
+// page_alloc(), each starting with a struct Slab header followed by as
+// many objects as fit.  Free objects are linked through their own
+// first word, so objects carry no header of their own, and free()
+// finds an object's slab, and from it the class, by rounding the
+// address down to its page.
+//
+// Requests too big for any class get whole pages from the buddy
+// allocator.  Those are the only page-aligned pointers malloc()
+// returns, which is how free() tells them apart.
+
+struct Slab {
+	LIST_ENTRY(Slab) sl_link;	// on the class's sc_partial list
+	struct Sizeclass *sl_class;	// class of the objects here
+	void *sl_free;			// first free object
+	uint16_t sl_inuse;		// objects handed out
+	uint16_t sl_nobj;		// objects in this slab
+};
+
+// Objects start this far into a slab page, past the header.
+#define SLAB_HDRSIZE	32
+
+// The size classes, in increasing order: the powers of two, and the
+// sizes half way between them, which many structures land just under.
+// The last one fits two objects in a page.
+struct Sizeclass sizeclass[] = {
+	{ 16 }, { 24 }, { 32 }, { 48 }, { 64 }, { 96 }, { 128 }, { 192 },
+	{ 256 }, { 384 }, { 512 }, { 768 }, { 1024 },
+	{ (PGSIZE - SLAB_HDRSIZE) / 2 },
+};
+#define NSIZECLASS	(sizeof(sizeclass) / sizeof(sizeclass[0]))
+const int nsizeclass = NSIZECLASS;
+
+// Statistics for allocations that get whole pages.
+struct Largestats largestats;
+
+// Set up a fresh slab page for class 'sc'.
+static struct Slab *
+slab_create(struct Sizeclass *sc)
+{
+	struct Page *pp;
+	struct Slab *sl;
+	char *obj;
+	int i;
+
+	static_assert(sizeof(struct Slab) <= SLAB_HDRSIZE);
+
+	if (page_alloc(&pp, 0) < 0)
+		return NULL;
+	sl = page2kva(pp);
+	sl->sl_class = sc;
+	sl->sl_inuse = 0;
+	sl->sl_nobj = (PGSIZE - SLAB_HDRSIZE) / sc->sc_size;
+
+	// thread the free list through the objects, in address order
+	obj = (char *) sl + SLAB_HDRSIZE;
+	sl->sl_free = obj;
+	for (i = 0; i < sl->sl_nobj - 1; i++, obj += sc->sc_size)
+		*(void **) obj = obj + sc->sc_size;
+	*(void **) obj = NULL;
+
+	LIST_INSERT_HEAD(&sc->sc_partial, sl, sl_link);
+	sc->sc_nslab++;
+	return sl;
+}
+
+// Allocate 'size' bytes of kernel memory.  Returns NULL if size is 0
+// or there is not enough memory.
+void *
+malloc(size_t size)
+{
+	struct Sizeclass *sc;
+	struct Slab *sl;
+	struct Page *pp;
+	void *obj;
+	int order;
+
+	if (size == 0)
+		return NULL;
+
+	for (sc = sizeclass; sc < sizeclass + NSIZECLASS; sc++)
+		if (size <= sc->sc_size)
+			break;
+
+	if (sc == sizeclass + NSIZECLASS) {
+		for (order = 0; (PGSIZE << order) < size; order++)
+			if (order == MAXORDER)
+				return NULL;
+		if ((order ? page_alloc_order(order, &pp) : page_alloc(&pp, 0)) < 0)
+			return NULL;
+		largestats.ls_inuse += 1 << order;
+		largestats.ls_nalloc++;
+		return page2kva(pp);
+	}
+
+	if ((sl = LIST_FIRST(&sc->sc_partial)) == NULL
+	    && (sl = slab_create(sc)) == NULL)
+		return NULL;
+
+	obj = sl->sl_free;
+	sl->sl_free = *(void **) obj;
+	if (++sl->sl_inuse == sl->sl_nobj)
+		LIST_REMOVE(sl, sl_link);	// full: off the partial list
+	sc->sc_inuse++;
+	sc->sc_nalloc++;
+	return obj;
+}
+
+// Free memory 'addr' that malloc() returned.  free(NULL) does nothing.
+void
+free(void *addr)
+{
+	struct Sizeclass *sc;
+	struct Slab *sl;
+	struct Page *pp;
+
+	if (addr == NULL)
+		return;
+
+	if (PGOFF(addr) == 0) {
+		pp = pa2page(PADDR(addr));
+		largestats.ls_inuse -= 1 << pp->pp_order;
+		largestats.ls_nfree++;
+		if (pp->pp_order == 0)
+			page_free(pp);
+		else
+			page_free_order(pp, pp->pp_order);
+		return;
+	}
+
+	sl = ROUNDDOWN(addr, PGSIZE);
+	sc = sl->sl_class;
+	assert(sl->sl_inuse > 0);
+
+	*(void **) addr = sl->sl_free;
+	sl->sl_free = addr;
+	if (sl->sl_inuse-- == sl->sl_nobj)
+		LIST_INSERT_HEAD(&sc->sc_partial, sl, sl_link);
+	sc->sc_inuse--;
+	sc->sc_nfree++;
+
+	// Give an empty slab's page back, unless it is the class's only
+	// partial slab, so that a malloc/free pair does not take and
+	// return a page each time.
+	if (sl->sl_inuse == 0
+	    && (LIST_FIRST(&sc->sc_partial) != sl || LIST_NEXT(sl, sl_link))) {
+		LIST_REMOVE(sl, sl_link);
+		sc->sc_nslab--;
+		page_free(pa2page(PADDR(sl)));
+	}
+}
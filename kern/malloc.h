@@ -0,0 +1,37 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_MALLOC_H
+#define JOS_KERN_MALLOC_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/queue.h>
+
+// One size class of the kernel's slab allocator (see kern/malloc.c)
+LIST_HEAD(Slab_list, Slab);
+
+struct Sizeclass {
+	size_t sc_size;			// bytes per object
+	struct Slab_list sc_partial;	// slabs with free objects
+
+	// statistics
+	uint32_t sc_nslab;		// slabs (pages) held
+	uint32_t sc_inuse;		// objects allocated now
+	uint32_t sc_nalloc;		// malloc() calls served
+	uint32_t sc_nfree;		// free() calls served
+};
+
+// Allocations too large for any size class
+struct Largestats {
+	uint32_t ls_inuse;		// pages allocated now
+	uint32_t ls_nalloc;		// malloc() calls served
+	uint32_t ls_nfree;		// free() calls served
+};
+
+extern struct Sizeclass sizeclass[];
+extern const int nsizeclass;
+extern struct Largestats largestats;
+
+#endif /* !JOS_KERN_MALLOC_H */
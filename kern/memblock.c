@@ -0,0 +1,166 @@
+/* See COPYRIGHT for copyright information. */
+
+#include <inc/types.h>
+#include <inc/mmu.h>
+#include <inc/memlayout.h>
+#include <inc/string.h>
+#include <inc/assert.h>
+
+#include <kern/pmap.h>
+#include <kern/memblock.h>
+
+// Boot-time physical memory allocator.
+//
+// Until the page allocator is up, physical memory is described by two
+// sets of address ranges: 'memory', the RAM the firmware reported, and
+// 'reserved', the parts of it that are in use or must not be used.
+// Allocating reserves a free aligned range; when the page allocator
+// takes over, it is handed each free range (memory minus reserved)
+// whole, and memblock is not used again.
+//
+// Ranges are kept sorted and merged.  They cover all of physical
+// memory, but allocations come from below MAXKPA only, since that is
+// all the kernel can reach through KERNBASE.
+
+#define NMEMRANGE	64
+
+struct Memrange {
+	physaddr_t mr_base;
+	physaddr_t mr_end;		// one past the last byte
+};
+
+struct Memranges {
+	int mrs_cnt;
+	struct Memrange mrs_range[NMEMRANGE];
+};
+
+static struct Memranges memory, reserved;
+static bool memblock_done;	// handed over to the page allocator
+
+// Add [base, end) to 'mrs', merging it with any range it overlaps
+// or touches.
+static void
+memranges_add(struct Memranges *mrs, physaddr_t base, physaddr_t end)
+{
+	struct Memrange *r = mrs->mrs_range;
+	int i, j;
+
+	if (base >= end)
+		return;
+
+	// r[i..j) are the ranges [base, end) overlaps or touches
+	for (i = 0; i < mrs->mrs_cnt && r[i].mr_end < base; i++)
+		/* do nothing */;
+	for (j = i; j < mrs->mrs_cnt && r[j].mr_base <= end; j++) {
+		base = MIN(base, r[j].mr_base);
+		end = MAX(end, r[j].mr_end);
+	}
+
+	// replace them with the one range [base, end)
+	if (i == j) {
+		if (mrs->mrs_cnt == NMEMRANGE)
+			panic("memblock: more than %d ranges", NMEMRANGE);
+		memmove(&r[i + 1], &r[i], (mrs->mrs_cnt - i) * sizeof(r[0]));
+		mrs->mrs_cnt++;
+	} else if (j > i + 1) {
+		memmove(&r[i + 1], &r[j], (mrs->mrs_cnt - j) * sizeof(r[0]));
+		mrs->mrs_cnt -= j - i - 1;
+	}
+	r[i].mr_base = base;
+	r[i].mr_end = end;
+}
+
+// Note that [base, base+size) is RAM.
+void
+memblock_add(physaddr_t base, physaddr_t size)
+{
+	memranges_add(&memory, base, base + size);
+}
+
+// Note that [base, base+size) is in use, or not to be used.
+void
+memblock_reserve(physaddr_t base, physaddr_t size)
+{
+	memranges_add(&reserved, base, base + size);
+}
+
+// Allocate 'size' bytes of physical memory aligned on an 'align'-byte
+// boundary (a power of two), and return its physical address.  The
+// memory is uninitialized.  Returns 0 if there is no room.
+//
+// Allocations are taken from the lowest free range above EXTPHYSMEM,
+// close to the kernel, so low memory stays free for whatever needs
+// addresses below 1MB.  They are always below MAXKPA.
+physaddr_t
+memblock_alloc(size_t size, size_t align)
+{
+	struct Memrange *m, *r;
+	physaddr_t pa, end;
+
+	if (memblock_done)
+		panic("memblock_alloc: page allocator is already running");
+
+	for (m = memory.mrs_range; m < memory.mrs_range + memory.mrs_cnt; m++) {
+		if (m->mr_base >= MAXKPA)
+			break;
+		end = MIN(m->mr_end, MAXKPA);
+		pa = ROUNDUP(MAX(m->mr_base, EXTPHYSMEM), align);
+
+		// skip past each reserved range in the way
+		for (r = reserved.mrs_range;
+		     r < reserved.mrs_range + reserved.mrs_cnt; r++) {
+			if (r->mr_end <= pa)
+				continue;
+			if (r->mr_base >= pa + size || r->mr_end >= end)
+				break;
+			pa = ROUNDUP(r->mr_end, align);
+		}
+
+		if (pa >= MAX(m->mr_base, EXTPHYSMEM) && pa + size > pa
+		    && pa + size <= end
+		    && (r == reserved.mrs_range + reserved.mrs_cnt
+			|| r->mr_base >= pa + size)) {
+			memblock_reserve(pa, size);
+			return pa;
+		}
+	}
+	return 0;
+}
+
+// Call fn(start, end) for each range [start, end) of RAM, reserved
+// or not.
+void
+memblock_foreach_memory(void (*fn)(physaddr_t start, physaddr_t end))
+{
+	struct Memrange *m;
+
+	for (m = memory.mrs_range; m < memory.mrs_range + memory.mrs_cnt; m++)
+		fn(m->mr_base, m->mr_end);
+}
+
+// Call fn(start, end) for each free range [start, end): memory that is
+// not reserved.  This hands memory over to the page allocator; memblock
+// can not allocate any more afterwards.
+void
+memblock_foreach_free(void (*fn)(physaddr_t start, physaddr_t end))
+{
+	struct Memrange *m, *r;
+	physaddr_t pa;
+
+	memblock_done = 1;
+	for (m = memory.mrs_range; m < memory.mrs_range + memory.mrs_cnt; m++) {
+		pa = m->mr_base;
+		for (r = reserved.mrs_range;
+		     r < reserved.mrs_range + reserved.mrs_cnt; r++) {
+			if (r->mr_end <= pa)
+				continue;
+			if (r->mr_base >= m->mr_end)
+				break;
+			if (r->mr_base > pa)
+				fn(pa, r->mr_base);
+			pa = r->mr_end;
+		}
+		if (pa < m->mr_end)
+			fn(pa, m->mr_end);
+	}
+}
@@ -0,0 +1,17 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_MEMBLOCK_H
+#define JOS_KERN_MEMBLOCK_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+void		memblock_add(physaddr_t base, physaddr_t size);
+void		memblock_reserve(physaddr_t base, physaddr_t size);
+physaddr_t	memblock_alloc(size_t size, size_t align);
+void		memblock_foreach_memory(void (*fn)(physaddr_t start, physaddr_t end));
+void		memblock_foreach_free(void (*fn)(physaddr_t start, physaddr_t end));
+
+#endif /* !JOS_KERN_MEMBLOCK_H */
@@ -6,10 +6,17 @@
 #include <inc/memlayout.h>
 #include <inc/assert.h>
 #include <inc/x86.h>
+#include <inc/bootinfo.h>
+#include <inc/malloc.h>
 
 #include <kern/console.h>
 #include <kern/monitor.h>
 #include <kern/kdebug.h>
+#include <kern/kclock.h>
+#include <kern/pmap.h>
+#include <kern/cpu.h>
+#include <kern/malloc.h>
+#include <kern/pool.h>
 
 #define CMDBUF_SIZE	80	// enough for one VGA text line
 
@@ -25,6 +32,18 @@ static struct Command commands[] = {
 	{ "help", "Display this list of commands", mon_help },
 	{ "kerninfo", "Display information about the kernel", mon_kerninfo },
 	{ "backtrace"	, "Display a listing of function call frames", mon_backtrace },
+	{ "boottime", "Display how long each boot phase took", mon_boottime },
+	{ "pagestress", "Benchmark the page allocator [iterations]", mon_pagestress },
+	{ "pcache", "Display the per-CPU page cache statistics", mon_pcache },
+	{ "kmstat", "Display kernel malloc usage by size class", mon_kmstat },
+	{ "zpool", "Display the zero pool and time zeroed allocations", mon_zpool },
+	{ "pagewalk", "Time a walk over every page's refcount [rounds]", mon_pagewalk },
+	{ "ptbench", "Time unmapping with invlpg against a TLB flush", mon_ptbench },
+	{ "colourbench", "Compare plain and colour-spread pages [hot pages]", mon_colourbench },
+	{ "numa", "Display NUMA nodes and time loads from each", mon_numa },
+	{ "pools", "Display object pool usage", mon_pools },
+	{ "poolbench", "Time a pool against malloc [objects]", mon_poolbench },
+	{ "serialbench", "Time console output [chars [baud]]", mon_serialbench },
 };
 #define NCOMMANDS (sizeof(commands)/sizeof(commands[0]))
 
@@ -85,7 +104,728 @@ mon_backtrace(int argc, char **argv, struct Trapframe *tf)
 	return 0;
 }
 
+static const char *boot_phases[BT_NPHASE] = {
+	[BT_START] = "start",
+	[BT_A20] = "a20",
+	[BT_PROT] = "protmode",
+	[BT_LOADER] = "loader",
+	[BT_KERNEL] = "kernel",
+	[BT_PAGING] = "paging",
+	[BT_BSS] = "bss",
+	[BT_CONS] = "console",
+	[BT_PROMPT] = "prompt",
+};
+
+// Print one line of the boot timeline: the time since the first
+// timestamp 't0' in cycles and microseconds, and the cycles since
+// the previous line's timestamp '*prev'.
+static void
+boottime_line(const char *name, int n, uint64_t t, uint64_t t0,
+	      uint64_t *prev, uint64_t khz)
+{
+	char label[16];
+
+	if (n >= 0)
+		snprintf(label, sizeof(label), "%s %d", name, n);
+	else
+		snprintf(label, sizeof(label), "%s", name);
+	cprintf("  %-12s %12llu %12llu %10llu\n", label,
+		t - t0, t - *prev, (t - t0) * 1000 / khz);
+	*prev = t;
+}
+
+int
+mon_boottime(int argc, char **argv, struct Trapframe *tf)
+{
+	uint64_t t0, prev, khz;
+	uint32_t i, nload;
+	int ph;
+
+	// Times are counted from the earliest phase recorded; only the
+	// kernel's own phases are there if our boot loader did not run.
+	t0 = 0;
+	for (ph = 0; ph < BT_NPHASE && !t0; ph++)
+		t0 = bootinfo.bi_tsc[ph];
+	if (!t0) {
+		cprintf("No boot timestamps recorded\n");
+		return 0;
+	}
+
+	khz = tsc_khz();
+	cprintf("TSC runs at %llu kHz\n", khz);
+	cprintf("  %-12s %12s %12s %10s\n", "phase", "cycles", "delta", "usec");
+	prev = t0;
+	for (ph = 0; ph < BT_NPHASE; ph++) {
+		if (!bootinfo.bi_tsc[ph])
+			continue;
+		// each load step finished between these two phases
+		if (ph == BT_KERNEL) {
+			nload = MIN(bootinfo.bi_nload, BI_NLOAD);
+			for (i = 0; i < nload; i++)
+				boottime_line("load", i, bootinfo.bi_tload[i],
+					      t0, &prev, khz);
+			if (bootinfo.bi_nload > BI_NLOAD)
+				cprintf("  (%u more load steps not recorded)\n",
+					bootinfo.bi_nload - BI_NLOAD);
+		}
+		boottime_line(boot_phases[ph], -1, bootinfo.bi_tsc[ph],
+			      t0, &prev, khz);
+	}
+	return 0;
+}
+
+// Count the free pages, and how many of them are in free blocks of
+// order 'minorder' or more.  Pages in the per-CPU caches count as
+// free single pages.
+static size_t
+free_pages(int minorder, size_t *nbig)
+{
+	size_t n, total;
+	int k;
+
+	total = *nbig = 0;
+	for (k = 0; k < NCPU; k++)
+		total += pcache[k].pc_count;
+	for (k = 0; k < NORDER; k++) {
+		n = page_free_blocks(k) << k;
+		total += n;
+		if (k >= minorder)
+			*nbig += n;
+	}
+	return total;
+}
+
+static void
+print_free_blocks(void)
+{
+	size_t nfree, nbig;
+	int k;
+
+	cprintf("  free blocks by order:");
+	for (k = 0; k < NORDER; k++)
+		cprintf(" %u", page_free_blocks(k));
+	nfree = free_pages(MAXORDER, &nbig);
+	cprintf("\n  %u pages free, %u%% of them outside %dKB blocks\n",
+		nfree, nfree ? 100 - (uint32_t) (nbig * 100ULL / nfree) : 0,
+		(PGSIZE << MAXORDER) / 1024);
+}
+
+#define STRESS_SLOTS	1024
+#define STRESS_MAXORDER	6
+
+static void
+stress_free(struct Page *pp)
+{
+	if (pp->pp_order == 0)
+		page_free(pp);
+	else
+		page_free_order(pp, pp->pp_order);
+}
+
+// Allocate and free blocks of random sizes as fast as possible, then
+// report the rate and how fragmented free memory ended up.  Single
+// pages go through page_alloc() and page_free(), and so through the
+// per-CPU cache, like most allocations in the kernel.
+int
+mon_pagestress(int argc, char **argv, struct Trapframe *tf)
+{
+	static struct Page *slot[STRESS_SLOTS];
+	uint32_t iters, i, j, r, nalloc, nfree, nfail, rnd;
+	uint64_t t0, cycles;
+	size_t before, after, nbig;
+	int order;
+
+	iters = argc > 1 ? strtol(argv[1], 0, 0) : 100000;
+	before = free_pages(0, &nbig);
+	cprintf("Before:\n");
+	print_free_blocks();
+
+	// Each step picks a slot at random and frees the block there, or
+	// if the slot is empty, fills it with a block of order k with
+	// probability 2^-(k+1), so most requests are for single pages.
+	nalloc = nfree = nfail = 0;
+	rnd = 1;
+	t0 = read_tsc();
+	for (i = 0; i < iters; i++) {
+		rnd = rnd * 1103515245 + 12345;
+		j = (rnd >> 8) % STRESS_SLOTS;
+		if (slot[j]) {
+			stress_free(slot[j]);
+			slot[j] = 0;
+			nfree++;
+			continue;
+		}
+		r = rnd >> 18;
+		for (order = 0; order < STRESS_MAXORDER && (r & (1 << order)); order++)
+			/* do nothing */;
+		if ((order ? page_alloc_order(order, &slot[j])
+		     : page_alloc(&slot[j], 0)) == 0)
+			nalloc++;
+		else
+			nfail++;
+	}
+	cycles = read_tsc() - t0;
+
+	cprintf("%u allocations, %u frees, %u failed in %llu cycles\n",
+		nalloc, nfree, nfail, cycles);
+	if (cycles)
+		cprintf("  %llu operations/sec, %llu cycles each\n",
+			(nalloc + nfree) * tsc_khz() * 1000 / cycles,
+			cycles / MAX(nalloc + nfree, 1));
+	cprintf("With the survivors still allocated:\n");
+	print_free_blocks();
+
+	for (i = 0; i < STRESS_SLOTS; i++)
+		if (slot[i]) {
+			stress_free(slot[i]);
+			slot[i] = 0;
+		}
+	after = free_pages(0, &nbig);
+	cprintf("After freeing everything:\n");
+	print_free_blocks();
+	if (after != before)
+		cprintf("  %d pages lost!\n", before - after);
+	return 0;
+}
+
+int
+mon_pcache(int argc, char **argv, struct Trapframe *tf)
+{
+	struct Pcache *pc;
+	uint32_t nalloc;
+	int i;
+
+	cprintf("cpu  cached      hits    misses  hit%%   refills    drains\n");
+	for (i = 0; i < NCPU; i++) {
+		pc = &pcache[i];
+		nalloc = pc->pc_hits + pc->pc_misses;
+		if (nalloc == 0 && pc->pc_count == 0)
+			continue;
+		cprintf("%3d %7u %9u %9u %4u%% %9u %9u\n", i, pc->pc_count,
+			pc->pc_hits, pc->pc_misses,
+			nalloc ? (uint32_t) (pc->pc_hits * 100ULL / nalloc) : 0,
+			pc->pc_refills, pc->pc_drains);
+	}
+	return 0;
+}
+
+int
+mon_kmstat(int argc, char **argv, struct Trapframe *tf)
+{
+	struct Sizeclass *sc;
+	uint32_t bytes, pages;
+
+	cprintf("  size  slabs   in use     bytes    allocs     frees\n");
+	bytes = pages = 0;
+	for (sc = sizeclass; sc < sizeclass + nsizeclass; sc++) {
+		cprintf("%6u %6u %8u %9u %9u %9u\n", sc->sc_size, sc->sc_nslab,
+			sc->sc_inuse, sc->sc_inuse * sc->sc_size,
+			sc->sc_nalloc, sc->sc_nfree);
+		bytes += sc->sc_inuse * sc->sc_size;
+		pages += sc->sc_nslab;
+	}
+	cprintf(" large %6s %8u %9u %9u %9u\n", "-", largestats.ls_inuse,
+		largestats.ls_inuse * PGSIZE, largestats.ls_nalloc,
+		largestats.ls_nfree);
+	cprintf("%u bytes in %u slab pages (%u%% used), %u large pages\n",
+		bytes, pages, pages ? (uint32_t) (bytes * 100ULL / (pages * PGSIZE)) : 0,
+		largestats.ls_inuse);
+	return 0;
+}
+
+#define ZBENCH_PAGES	32
+
+// Time allocating zeroed pages 'n' at a time, and free them again.
+static uint64_t
+zbench(struct Page **pp, int n)
+{
+	uint64_t t0, cycles;
+	int i, got;
+
+	t0 = read_tsc();
+	for (got = 0; got < n; got++)
+		if (page_alloc(&pp[got], ALLOC_ZERO) < 0)
+			break;
+	cycles = read_tsc() - t0;
+	for (i = 0; i < got; i++)
+		page_free(pp[i]);
+	return got ? cycles / got : 0;
+}
+
+// Show the zero pool, then compare what page_alloc(ALLOC_ZERO) costs
+// with pages taken from the pool against pages zeroed on the spot.
+int
+mon_zpool(int argc, char **argv, struct Trapframe *tf)
+{
+	struct Page *pp[ZBENCH_PAGES];
+	struct Zpool saved;
+	uint32_t nalloc;
+	uint64_t pool, sync;
+
+	nalloc = zpool.zp_hits + zpool.zp_misses;
+	cprintf("%u of %u pages zeroed and ready, %u zeroed while idle\n",
+		zpool.zp_count, ZPOOL_TARGET, zpool.zp_zeroed);
+	cprintf("%u zeroed allocations: %u from the pool (%u%%), %u zeroed on the spot\n",
+		nalloc, zpool.zp_hits,
+		nalloc ? (uint32_t) (zpool.zp_hits * 100ULL / nalloc) : 0,
+		zpool.zp_misses);
+
+	// Hide the pool for one round, so every page has to be zeroed
+	// on the spot, then take pages from it for another.  The pages
+	// go back dirty; page_zero_idle() refills the pool at the next
+	// prompt.  Neither round counts in the statistics.
+	saved = zpool;
+	zpool.zp_list.pl_first = NOPAGE;
+	zpool.zp_count = 0;
+	sync = zbench(pp, ZBENCH_PAGES);
+	zpool = saved;
+	pool = zbench(pp, MIN(zpool.zp_count, ZBENCH_PAGES));
+	zpool.zp_hits = saved.zp_hits;
+	if (pool)
+		cprintf("  %llu cycles per page from the pool\n", pool);
+	if (sync)
+		cprintf("  %llu cycles per page zeroed on the spot\n", sync);
+	return 0;
+}
+
+// Walk the metadata of every physical page, reading the reference
+// count and flags as a scan for pages in use would, and report how
+// long a walk takes and how much memory it touches.
+int
+mon_pagewalk(int argc, char **argv, struct Trapframe *tf)
+{
+	uint32_t rounds, r, i;
+	uint64_t t0, cycles, nref, nfree;
+
+	rounds = argc > 1 ? strtol(argv[1], 0, 0) : 10;
+	if (rounds == 0)
+		return 0;
+
+	nref = nfree = 0;
+	t0 = read_tsc();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < npage; i++) {
+			nref += pages[i].pp_ref;
+			if (pages[i].pp_flags & PP_FREE)
+				nfree += 1 << pages[i].pp_order;
+		}
+	cycles = read_tsc() - t0;
+
+	cprintf("%u pages, %llu references, %llu pages in free blocks\n",
+		npage, nref / rounds, nfree / rounds);
+	cprintf("  walked %u bytes of struct Page (%u each); "
+		"%u bytes of list links left alone\n",
+		npage * sizeof(struct Page), sizeof(struct Page),
+		npage * sizeof(struct Page_link));
+	cprintf("  %llu cycles per walk, %llu cycles per 1000 pages\n",
+		cycles / rounds, cycles * 1000 / rounds / MAX(npage, 1));
+	return 0;
+}
+
+// Somewhere in the part of the address space nothing uses yet
+#define PTBENCH_VA	0x40000000
+#define PTBENCH_ROUNDS	16
+
+// Map 'n' pages at PTBENCH_VA, pull them into the TLB, and return
+// the cycles pt_unmap_range() takes to unmap them again when it may
+// use invlpg for at most 'thresh' pages.
+static uint64_t
+ptbench_unmap(uint32_t n, uint32_t thresh)
+{
+	volatile uint8_t *va = (volatile uint8_t *) PTBENCH_VA;
+	uint32_t saved, i;
+	uint64_t t0, cycles;
+
+	// any physical memory will do; it is only read
+	if (pt_map_range(PTBENCH_VA, 0, n * PGSIZE, 0) < 0)
+		return 0;
+	for (i = 0; i < n; i++)
+		(void) va[i * PGSIZE];
+
+	saved = tlb_invlpg_max;
+	tlb_invlpg_max = thresh;
+	t0 = read_tsc();
+	pt_unmap_range(PTBENCH_VA, n * PGSIZE);
+	cycles = read_tsc() - t0;
+	tlb_invlpg_max = saved;
+	return cycles;
+}
+
+// For ranges of 1 to TLBBATCH_MAX pages, compare the cost of unmapping
+// them with an invlpg per page against a single TLB flush, to help pick
+// tlb_invlpg_max.  A flush also costs TLB misses later on, which this
+// does not count.
+int
+mon_ptbench(int argc, char **argv, struct Trapframe *tf)
+{
+	struct Tlbstats saved = tlbstats;
+	uint64_t inv, flush;
+	uint32_t n, r;
+
+	cprintf("invlpg is used for up to %u pages, then a flush\n",
+		tlb_invlpg_max);
+	cprintf("pages  invlpg cycles  flush cycles\n");
+	for (n = 1; n <= TLBBATCH_MAX; n *= 2) {
+		inv = flush = 0;
+		for (r = 0; r < PTBENCH_ROUNDS; r++) {
+			inv += ptbench_unmap(n, TLBBATCH_MAX);
+			flush += ptbench_unmap(n, 0);
+		}
+		cprintf("%5u %14llu %13llu\n", n,
+			inv / PTBENCH_ROUNDS, flush / PTBENCH_ROUNDS);
+	}
+	tlbstats = saved;
+	cprintf("%u pages invalidated one by one, %u full flushes\n",
+		tlbstats.ts_invlpg, tlbstats.ts_flush);
+	return 0;
+}
+
+#define CBENCH_MAXHOT	256
+#define CBENCH_PASSES	64
+
+static struct Page *cbench_hot[CBENCH_MAXHOT];
 
+// Allocate 'nhot' pages the program keeps using, with page_alloc_spread()
+// if 'spread' is set, and after each, ncolour-1 pages it does not; then
+// time reading every cache line of the hot pages over and over.  Returns
+// cycles per hot page per pass, and in *maxshare the most hot pages that
+// ended up with the same colour.
+static uint64_t
+colourbench_run(uint32_t nhot, int spread, uint32_t *maxshare)
+{
+	uint32_t count[MAXCOLOUR];
+	volatile uint32_t *p;
+	void *fill, *next;
+	struct Page *pp;
+	uint32_t i, j, off, pass, sum;
+	uint64_t t0;
+
+	memset(count, 0, sizeof(count));
+	fill = NULL;
+	for (i = 0; i < nhot; i++) {
+		if ((spread ? page_alloc_spread(&cbench_hot[i])
+		     : page_alloc(&cbench_hot[i], 0)) < 0)
+			break;
+		count[page2colour(cbench_hot[i])]++;
+		// the cold pages are chained through their first word
+		for (j = 1; j < ncolour && page_alloc(&pp, 0) == 0; j++) {
+			*(void **) page2kva(pp) = fill;
+			fill = page2kva(pp);
+		}
+	}
+	nhot = i;
+	for (*maxshare = 0, j = 0; j < ncolour; j++)
+		*maxshare = MAX(*maxshare, count[j]);
+
+	// the first pass only brings the pages into the cache
+	sum = 0;
+	t0 = 0;
+	for (pass = 0; pass <= CBENCH_PASSES; pass++) {
+		if (pass == 1)
+			t0 = read_tsc();
+		for (i = 0; i < nhot; i++) {
+			p = page2kva(cbench_hot[i]);
+			for (off = 0; off < PGSIZE; off += l2geom.cg_line)
+				sum += p[off / sizeof(*p)];
+		}
+	}
+	t0 = read_tsc() - t0;
+
+	for (i = 0; i < nhot; i++)
+		page_free(cbench_hot[i]);
+	for (; fill; fill = next) {
+		next = *(void **) fill;
+		page_free(pa2page(PADDR(fill)));
+	}
+	return nhot ? t0 / CBENCH_PASSES / nhot : 0;
+}
+
+// Show the L2 geometry and page colours, then run colourbench_run()
+// both ways.  By default the hot set is twice the L2's associativity:
+// one colour's worth of cache can not hold it, all of the cache can.
+int
+mon_colourbench(int argc, char **argv, struct Trapframe *tf)
+{
+	uint32_t nhot, share;
+	uint64_t cycles;
+
+	cprintf("L2: %uK, %u-way, %u-byte lines; %u page colours\n",
+		l2geom.cg_size / 1024, l2geom.cg_ways, l2geom.cg_line, ncolour);
+	if (ncolour == 1 || l2geom.cg_line == 0) {
+		cprintf("nothing to compare\n");
+		return 0;
+	}
+
+	nhot = argc > 1 ? strtol(argv[1], 0, 0) : 2 * l2geom.cg_ways;
+	nhot = MIN(MAX(nhot, 1), CBENCH_MAXHOT);
+	cprintf("%u hot pages, %u cold ones allocated after each\n",
+		nhot, ncolour - 1);
+	cycles = colourbench_run(nhot, 0, &share);
+	cprintf("  page_alloc:        %llu cycles per page, "
+		"up to %u pages of one colour\n", cycles, share);
+	cycles = colourbench_run(nhot, 1, &share);
+	cprintf("  page_alloc_spread: %llu cycles per page, "
+		"up to %u pages of one colour\n", cycles, share);
+	return 0;
+}
+
+// A block bigger than most L2 caches, so that the chase misses in them
+#define NUMABENCH_ORDER	10
+#define NUMABENCH_LOADS	(1 << 20)
+
+// The start of each cache line numabench_chase() follows
+struct Numaline {
+	struct Numaline *nl_next;	// line to load next
+	uint32_t nl_pos;		// line that comes this one's turn
+};
+
+static struct Numaline *numabench_sink;
+
+// Link the cache lines of the 2^order pages at 'va' into one cycle in
+// random order, so the hardware can not prefetch along it, then follow
+// it.  Returns cycles per load.
+static uint64_t
+numabench_chase(void *va, int order)
+{
+	struct Numaline *p;
+	uint32_t line, n, i, j, t, seed;
+	uint64_t t0;
+
+	line = l2geom.cg_line ? l2geom.cg_line : 64;
+	n = (PGSIZE << order) / line;
+#define LINE(i)	((struct Numaline *) ((char *) va + (i) * line))
+
+	// shuffle the order the lines come in
+	for (i = 0; i < n; i++)
+		LINE(i)->nl_pos = i;
+	seed = read_tsc();
+	for (i = n - 1; i > 0; i--) {
+		seed = seed * 1103515245 + 12345;
+		j = (seed >> 8) % (i + 1);
+		t = LINE(i)->nl_pos;
+		LINE(i)->nl_pos = LINE(j)->nl_pos;
+		LINE(j)->nl_pos = t;
+	}
+	for (i = 0; i < n; i++)
+		LINE(LINE(i)->nl_pos)->nl_next = LINE(LINE((i + 1) % n)->nl_pos);
+
+	p = LINE(0);
+	for (i = 0; i < n; i++)		// warm up the TLB
+		p = p->nl_next;
+	t0 = read_tsc();
+	for (i = 0; i < NUMABENCH_LOADS; i++)
+		p = p->nl_next;
+	t0 = read_tsc() - t0;
+	numabench_sink = p;
+#undef LINE
+	return t0 / NUMABENCH_LOADS;
+}
+
+// Show each NUMA node's memory and distances, then time loads from
+// the running CPU to memory on each node.
+int
+mon_numa(int argc, char **argv, struct Trapframe *tf)
+{
+	size_t nfree[MAXNODE];
+	struct Page *pp;
+	void *va;
+	uint32_t i;
+	int node, j, order;
+
+	memset(nfree, 0, sizeof(nfree));
+	for (i = 0; i < npage; i++) {
+		if (pages[i].pp_flags & PP_FREE)
+			nfree[page2node(&pages[i])] += 1 << pages[i].pp_order;
+		else if (pages[i].pp_flags & (PP_CACHED | PP_ZERO | PP_COLOUR))
+			nfree[page2node(&pages[i])]++;
+	}
+
+	cprintf("node    pages     free     used  distances\n");
+	for (node = 0; node < nnode; node++) {
+		cprintf("%4d %8u %8u %8u ", node, node_npage[node],
+			nfree[node], node_npage[node] - nfree[node]);
+		for (j = 0; j < nnode; j++)
+			cprintf(" %3u", numa_dist[node][j]);
+		cprintf("\n");
+	}
+
+	cprintf("load latency from node %d, where this CPU is:\n",
+		numa_node());
+	for (node = 0; node < nnode; node++) {
+		// A node's memory may all be high, and a high block is
+		// mapped in the kmap() window, which only takes so much.
+		for (order = NUMABENCH_ORDER; order >= 0; order--) {
+			if (page_alloc_node(node, order, ALLOC_HIGH, &pp) < 0)
+				continue;
+			if ((va = kmap_block(pp, order)) != NULL)
+				break;
+			page_free_order(pp, order);
+		}
+		if (order < 0) {
+			cprintf("  node %d: no free memory\n", node);
+			continue;
+		}
+		cprintf("  node %d: %llu cycles per load over %uK\n", node,
+			numabench_chase(va, order), (PGSIZE << order) / 1024);
+		kunmap_block(va, order);
+		page_free_order(pp, order);
+	}
+	return 0;
+}
+
+int
+mon_pools(int argc, char **argv, struct Trapframe *tf)
+{
+	struct Poolstats *ps;
+
+	cprintf("pool          size   total   inuse   hiwat   allocs  failed\n");
+	for (ps = pool_list; ps; ps = ps->ps_next)
+		cprintf("%-12s %5u %7u %7u %7u %8u %7u\n", ps->ps_name,
+			ps->ps_size, ps->ps_total, ps->ps_inuse, ps->ps_hiwat,
+			ps->ps_nalloc, ps->ps_nfail);
+	return 0;
+}
+
+// An object of a typical small size for poolbench
+struct Pbobj {
+	uint32_t pb_data[11];
+	POOL_ENTRY(Pbobj) pb_free;
+};
+
+POOL_HEAD(Pbpool, Pbobj, NCPU);
+POOL_GENERATE(static, pbpool, Pbpool, Pbobj, pb_free, cpunum(),
+	      POOL_NOHOOK, POOL_NOHOOK)
+
+static struct Pbpool pbpool;
+
+#define PBENCH_MAXOBJ	1024
+
+// Allocate and then free 'n' objects from the pool, twice, and return
+// the cycles the second round took; the first only warms it up.
+// Returns 0 if the pool runs out.
+static uint64_t
+poolbench_pool(struct Pbobj **obj, uint32_t n)
+{
+	uint64_t t;
+	uint32_t i, got;
+	int round;
+
+	for (round = 0; round < 2; round++) {
+		t = read_tsc();
+		for (i = 0; i < n; i++)
+			if ((obj[i] = pbpool_alloc(&pbpool)) == NULL)
+				break;
+		got = i;
+		while (i > 0)
+			pbpool_free(&pbpool, obj[--i]);
+		if (got < n)
+			return 0;
+	}
+	return read_tsc() - t;
+}
+
+// Likewise with malloc() and free().
+static uint64_t
+poolbench_malloc(struct Pbobj **obj, uint32_t n)
+{
+	uint64_t t;
+	uint32_t i, got;
+	int round;
+
+	for (round = 0; round < 2; round++) {
+		t = read_tsc();
+		for (i = 0; i < n; i++)
+			if ((obj[i] = malloc(sizeof(struct Pbobj))) == NULL)
+				break;
+		got = i;
+		while (i > 0)
+			free(obj[--i]);
+		if (got < n)
+			return 0;
+	}
+	return read_tsc() - t;
+}
+
+// Allocate and then free 'n' objects, from a pool and with malloc(),
+// and compare the cycles each takes.
+int
+mon_poolbench(int argc, char **argv, struct Trapframe *tf)
+{
+	static struct Pbobj *obj[PBENCH_MAXOBJ];
+	static bool registered;
+	uint64_t tpool, tmalloc;
+	uint32_t n;
+
+	if (!registered) {
+		pbpool_init(&pbpool, "poolbench", pool_page_grow);
+		pool_register(&pbpool.ph_stats);
+		registered = 1;
+	}
+	n = argc > 1 ? strtol(argv[1], 0, 0) : 256;
+	n = MIN(MAX(n, 1), PBENCH_MAXOBJ);
+
+	if ((tpool = poolbench_pool(obj, n)) == 0
+	    || (tmalloc = poolbench_malloc(obj, n)) == 0) {
+		cprintf("out of memory\n");
+		return 0;
+	}
+
+	cprintf("%u objects of %u bytes, cycles per alloc+free:\n",
+		n, sizeof(struct Pbobj));
+	cprintf("  pool   %llu\n  malloc %llu\n", tpool / n, tmalloc / n);
+	return 0;
+}
+
+#define SBENCH_LINE	64
+#define SBENCH_MAXCHARS	(1 << 20)
+
+// Print 'n' characters, in lines, and time how long it takes to get
+// them all out of the serial port; optionally at another line rate,
+// which lasts only for the benchmark.
+int
+mon_serialbench(int argc, char **argv, struct Trapframe *tf)
+{
+	char line[SBENCH_LINE + 1];
+	uint32_t n, i, len, baud, oldbaud;
+	uint64_t t0, cycles;
+	int txfifo;
+	long count;
+
+	count = argc > 1 ? strtol(argv[1], 0, 0) : 4096;
+	if (count <= 0 || count > SBENCH_MAXCHARS) {
+		cprintf("count must be 1 to %d\n", SBENCH_MAXCHARS);
+		return 0;
+	}
+	n = MAX(count, SBENCH_LINE);
+	serial_status(&oldbaud, &txfifo);
+	if (argc > 2 && serial_setbaud(strtol(argv[2], 0, 0)) < 0) {
+		cprintf("unsupported rate %s\n", argv[2]);
+		return 0;
+	}
+	serial_status(&baud, &txfifo);
+
+	for (i = 0; i < SBENCH_LINE - 1; i++)
+		line[i] = 'a' + i % 26;
+	line[SBENCH_LINE - 1] = '\n';
+	line[SBENCH_LINE] = '\0';
+
+	// Time from an empty ring until everything has left it.
+	cons_sync(1);
+	t0 = read_tsc();
+	cons_sync(0);
+	for (i = 0; i < n; i += len) {
+		len = MIN(n - i, SBENCH_LINE);
+		cprintf("%s", line + SBENCH_LINE - len);
+	}
+	cons_sync(1);
+	cycles = read_tsc() - t0;
+	cons_sync(0);
+	serial_setbaud(oldbaud);
+
+	cprintf("%u chars at %u baud, %u-byte FIFO: %llu chars/sec\n",
+		n, baud, txfifo, (uint64_t) n * tsc_khz() * 1000 / cycles);
+	return 0;
+}
 
 /***** Kernel monitor command interpreter *****/
 
@@ -139,6 +879,8 @@ monitor(struct Trapframe *tf)
 	cprintf("Welcome to the JOS kernel monitor!\n");
 	cprintf("Type 'help' for a list of commands.\n");
 
+	if (!bootinfo.bi_tsc[BT_PROMPT])
+		bootinfo.bi_tsc[BT_PROMPT] = read_tsc();
 
 	while (1) {
 		buf = readline("K> ");
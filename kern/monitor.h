@@ -15,5 +15,17 @@ void monitor(struct Trapframe *tf);
 int mon_help(int argc, char **argv, struct Trapframe *tf);
 int mon_kerninfo(int argc, char **argv, struct Trapframe *tf);
 int mon_backtrace(int argc, char **argv, struct Trapframe *tf);
+int mon_boottime(int argc, char **argv, struct Trapframe *tf);
+int mon_pagestress(int argc, char **argv, struct Trapframe *tf);
+int mon_pcache(int argc, char **argv, struct Trapframe *tf);
+int mon_kmstat(int argc, char **argv, struct Trapframe *tf);
+int mon_zpool(int argc, char **argv, struct Trapframe *tf);
+int mon_pagewalk(int argc, char **argv, struct Trapframe *tf);
+int mon_ptbench(int argc, char **argv, struct Trapframe *tf);
+int mon_colourbench(int argc, char **argv, struct Trapframe *tf);
+int mon_numa(int argc, char **argv, struct Trapframe *tf);
+int mon_pools(int argc, char **argv, struct Trapframe *tf);
+int mon_poolbench(int argc, char **argv, struct Trapframe *tf);
+int mon_serialbench(int argc, char **argv, struct Trapframe *tf);
 
 #endif	// !JOS_KERN_MONITOR_H
@@ -0,0 +1,235 @@
+/* See COPYRIGHT for copyright information. */
+
+#include <inc/x86.h>
+#include <inc/string.h>
+#include <inc/stdio.h>
+#include <inc/assert.h>
+
+#include <kern/acpi.h>
+#include <kern/numa.h>
+
+// NUMA topology.
+//
+// The ACPI SRAT (System Resource Affinity Table) says which proximity
+// domain each CPU, by local APIC ID, and each range of memory belongs
+// to, and the SLIT (System Locality Information Table) how far apart
+// the domains are.  Domains get node numbers from 0 in the order the
+// SRAT first mentions them.  A machine without an SRAT is one node.
+
+#define SRAT_CPU	0		// processor local APIC affinity
+#define SRAT_MEMORY	1		// memory affinity
+#define SRAT_X2APIC	2		// processor local x2APIC affinity
+#define SRAT_ENABLED	0x1		// in each entry's flags
+
+struct Srat_cpu {
+	uint8_t sc_type;
+	uint8_t sc_len;
+	uint8_t sc_pxm_lo;		// proximity domain, bits 0-7
+	uint8_t sc_apic;		// local APIC ID
+	uint32_t sc_flags;
+	uint8_t sc_sapic;
+	uint8_t sc_pxm_hi[3];		// proximity domain, bits 8-31
+	uint32_t sc_clock;
+} __attribute__((packed));
+
+struct Srat_memory {
+	uint8_t sm_type;
+	uint8_t sm_len;
+	uint32_t sm_pxm;
+	uint16_t sm_reserved;
+	uint64_t sm_base;
+	uint64_t sm_size;
+	uint32_t sm_reserved2;
+	uint32_t sm_flags;
+	uint64_t sm_reserved3;
+} __attribute__((packed));
+
+struct Srat_x2apic {
+	uint8_t sx_type;
+	uint8_t sx_len;
+	uint16_t sx_reserved;
+	uint32_t sx_pxm;
+	uint32_t sx_apic;		// x2APIC ID
+	uint32_t sx_flags;
+	uint32_t sx_clock;
+	uint32_t sx_reserved2;
+} __attribute__((packed));
+
+int nnode = 1;				// Number of nodes
+struct Numarange numa_range[MAXNUMARANGE];	// Memory, by node
+int nnumarange;
+uint8_t numa_dist[MAXNODE][MAXNODE];	// SLIT distances, by node
+uint8_t node_fallback[MAXNODE][MAXNODE];	// Nodes, nearest first
+uint8_t cpu_node[NCPU];			// Node of each CPU
+
+static uint32_t node_pxm[MAXNODE];	// Proximity domain of each node
+static uint8_t apic_node[256];		// Node of each local APIC ID
+static bool apic_known[256];
+
+// Return the node for proximity domain 'pxm', making it a new one if
+// need be, or -1 if there are too many.
+static int
+pxm_node(uint32_t pxm)
+{
+	int n;
+
+	for (n = 0; n < nnode; n++)
+		if (node_pxm[n] == pxm)
+			return n;
+	if (nnode == MAXNODE)
+		return -1;
+	node_pxm[nnode] = pxm;
+	return nnode++;
+}
+
+static void
+srat_cpu(uint32_t apic, uint32_t pxm)
+{
+	int node;
+
+	if ((node = pxm_node(pxm)) < 0 || apic >= 256)
+		return;
+	apic_node[apic] = node;
+	apic_known[apic] = 1;
+}
+
+static void
+srat_memory(uint64_t base, uint64_t size, uint32_t pxm)
+{
+	struct Numarange *nr;
+	int node;
+
+	if ((node = pxm_node(pxm)) < 0)
+		return;
+	if (nnumarange == MAXNUMARANGE) {
+		cprintf("NUMA: more than %d memory ranges\n", MAXNUMARANGE);
+		return;
+	}
+	// only what physaddr_t can address
+	if ((physaddr_t) base != base)
+		return;
+	if ((physaddr_t) (base + size) != base + size)
+		size = (physaddr_t) -PGSIZE - base;
+	nr = &numa_range[nnumarange++];
+	nr->nr_base = base;
+	nr->nr_end = base + size;
+	nr->nr_node = node;
+}
+
+// Read the SRAT.  Returns 0 if there is none.
+static int
+srat_parse(void)
+{
+	struct Acpi_hdr *h;
+	struct Srat_cpu *sc;
+	struct Srat_memory *sm;
+	struct Srat_x2apic *sx;
+	uint8_t *p, *end;
+
+	if ((h = acpi_find_table("SRAT")) == NULL)
+		return 0;
+	// the entries follow 12 reserved bytes
+	end = (uint8_t *) h + h->ah_len;
+	for (p = (uint8_t *) (h + 1) + 12; p + 2 <= end && p[1] >= 2;
+	     p += p[1]) {
+		switch (p[0]) {
+		case SRAT_CPU:
+			sc = (struct Srat_cpu *) p;
+			if (sc->sc_flags & SRAT_ENABLED)
+				srat_cpu(sc->sc_apic, sc->sc_pxm_lo
+					 | sc->sc_pxm_hi[0] << 8
+					 | sc->sc_pxm_hi[1] << 16
+					 | sc->sc_pxm_hi[2] << 24);
+			break;
+		case SRAT_MEMORY:
+			sm = (struct Srat_memory *) p;
+			if ((sm->sm_flags & SRAT_ENABLED) && sm->sm_size)
+				srat_memory(sm->sm_base, sm->sm_size,
+					    sm->sm_pxm);
+			break;
+		case SRAT_X2APIC:
+			sx = (struct Srat_x2apic *) p;
+			if (sx->sx_flags & SRAT_ENABLED)
+				srat_cpu(sx->sx_apic, sx->sx_pxm);
+			break;
+		}
+	}
+	return 1;
+}
+
+// Read the SLIT, if there is one, into numa_dist[].
+static void
+slit_parse(void)
+{
+	struct Acpi_hdr *h;
+	uint64_t nloc;
+	uint8_t *d;
+	int i, j;
+
+	if ((h = acpi_find_table("SLIT")) == NULL)
+		return;
+	nloc = *(uint64_t *) (h + 1);
+	d = (uint8_t *) (h + 1) + 8;
+	if (sizeof(*h) + 8 + nloc * nloc > h->ah_len)
+		return;
+	// The SLIT is indexed by proximity domain.
+	for (i = 0; i < nnode; i++)
+		for (j = 0; j < nnode; j++)
+			if (node_pxm[i] < nloc && node_pxm[j] < nloc)
+				numa_dist[i][j] = d[node_pxm[i] * nloc
+						    + node_pxm[j]];
+}
+
+// Is node 'a' nearer to 'node' than 'b' is?
+static bool
+nearer(int node, int a, int b)
+{
+	if (a == node || b == node)
+		return a == node && b != node;
+	return numa_dist[node][a] < numa_dist[node][b];
+}
+
+// Find out the NUMA topology from ACPI, and the order in which each
+// node's allocations fall back to the others.  Must run before
+// page_init(), which puts each page on its node's free lists.
+void
+numa_init(void)
+{
+	uint32_t ebx;
+	int i, j, k, n;
+
+	for (i = 0; i < MAXNODE; i++)
+		for (j = 0; j < MAXNODE; j++)
+			numa_dist[i][j] = i == j ? NUMA_LOCAL : NUMA_REMOTE;
+	nnode = 0;
+	if (!srat_parse() || nnode == 0)
+		nnode = 1;
+	else
+		slit_parse();
+	acpi_release();
+
+	// Nearest first, by distance and then by node number; a node is
+	// always nearest to itself, whatever the SLIT says.
+	for (i = 0; i < nnode; i++)
+		for (n = 0; n < nnode; n++) {
+			for (k = n; k > 0 && nearer(i, n, node_fallback[i][k - 1]);
+			     k--)
+				node_fallback[i][k] = node_fallback[i][k - 1];
+			node_fallback[i][k] = n;
+		}
+
+	// The boot CPU's initial APIC ID, from CPUID
+	cpuid(1, 0, &ebx, 0, 0);
+	if (apic_known[ebx >> 24])
+		cpu_node[cpunum()] = apic_node[ebx >> 24];
+
+	if (nnode > 1) {
+		cprintf("NUMA: %d nodes, this CPU on node %d\n",
+			nnode, numa_node());
+		for (i = 0; i < nnumarange; i++)
+			cprintf("  node %d: %016llx-%016llx\n",
+				numa_range[i].nr_node,
+				(uint64_t) numa_range[i].nr_base,
+				(uint64_t) numa_range[i].nr_end - 1);
+	}
+}
@@ -0,0 +1,48 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_NUMA_H
+#define JOS_KERN_NUMA_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/memlayout.h>
+#include <kern/cpu.h>
+
+// NUMA nodes: the CPUs and memory of one socket (an ACPI proximity
+// domain).  A page's node is kept in the top bits of its pp_flags,
+// which leaves room for this many.
+#define MAXNODE		(1 << (8 - PP_NODESHIFT))
+
+// ACPI distances between nodes are relative to a node's distance to
+// itself, which is 10; without a SLIT, remote nodes are taken to be 20.
+#define NUMA_LOCAL	10
+#define NUMA_REMOTE	20
+
+// A physical address range, and the node it belongs to
+#define MAXNUMARANGE	32
+
+struct Numarange {
+	physaddr_t nr_base;
+	physaddr_t nr_end;		// one past the last byte
+	int nr_node;
+};
+
+extern int nnode;
+extern struct Numarange numa_range[];
+extern int nnumarange;
+extern uint8_t numa_dist[MAXNODE][MAXNODE];
+extern uint8_t node_fallback[MAXNODE][MAXNODE];
+extern uint8_t cpu_node[NCPU];
+
+void	numa_init(void);
+
+// The node the running CPU belongs to
+static inline int
+numa_node(void)
+{
+	return cpu_node[cpunum()];
+}
+
+#endif /* !JOS_KERN_NUMA_H */
@@ -0,0 +1,205 @@
+/* See COPYRIGHT for copyright information. */
+
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/stdio.h>
+#include <inc/assert.h>
+
+#include <kern/pmap.h>
+#include <kern/pat.h>
+#include <kern/memblock.h>
+
+// Memory types.
+//
+// The type of a physical access comes from two places: the MTRRs, set
+// per physical range, and the page attribute table (PAT), one of whose
+// eight entries each page table entry picks with its PAT, PCD and PWT
+// bits.  pat_init() loads the PAT below, which keeps the power-on
+// meaning of the PCD and PWT bits and puts WC where PWT alone used to
+// select WT, and makes sure the MTRRs are on, so that RAM is cached.
+
+#define CPUID_MTRR	(1 << 12)	// CPUID 1 %edx
+#define CPUID_PAT	(1 << 16)
+
+#define MSR_MTRRCAP		0x0FE
+#define MSR_MTRR_PHYSBASE(i)	(0x200 + 2 * (i))
+#define MSR_MTRR_PHYSMASK(i)	(0x201 + 2 * (i))
+#define MSR_MTRRFIX64K_00000	0x250
+#define MSR_MTRRFIX16K_80000	0x258
+#define MSR_MTRRFIX16K_A0000	0x259
+#define MSR_MTRRFIX4K_C0000	0x268	// through 0x26F for 0xFFFFF
+#define MSR_PAT			0x277
+#define MSR_MTRR_DEF_TYPE	0x2FF
+
+#define MTRRCAP_VCNT	0xFF		// number of variable ranges
+#define MTRRCAP_FIX	(1 << 8)	// fixed ranges supported
+#define MTRR_DEF_FE	(1 << 10)	// fixed ranges enabled
+#define MTRR_DEF_E	(1 << 11)	// MTRRs enabled
+#define MTRR_VALID	(1 << 11)	// in a PHYSMASK register
+
+// A fixed-range MTRR holds eight ranges, one type per byte
+#define MTRR_FIX(mt)	((mt) * 0x0101010101010101ULL)
+
+// PAT entry i is for PAT:PCD:PWT = i.  Entries 0-3 are as at power on,
+// except that 1 is WC rather than WT; WT moves to 7.
+#define PAT_ENTRY(i, mt)	((uint64_t) (mt) << (8 * (i)))
+#define PAT_VALUE	(PAT_ENTRY(0, MT_WB) | PAT_ENTRY(1, MT_WC)	\
+			 | PAT_ENTRY(2, MT_UCMINUS) | PAT_ENTRY(3, MT_UC) \
+			 | PAT_ENTRY(4, MT_WB) | PAT_ENTRY(5, MT_WP)	\
+			 | PAT_ENTRY(6, MT_UCMINUS) | PAT_ENTRY(7, MT_WT))
+
+static bool have_pat;
+
+// Variable-range MTRRs being handed out by mtrr_cover()
+static struct {
+	uint64_t addrmask;	// PHYSMASK bits that hold an address
+	uint32_t nvar;		// ranges the CPU has
+	uint32_t next;		// next one to program
+	uint64_t missed;	// bytes of RAM there were none left for
+	uint64_t start, end;	// RAM seen but not yet covered
+} mtrr_var;
+
+// Return the PTE bits that give a 4KB page memory type 'memtype'.
+// Without a PAT, WC falls back to UC- and WP to UC.
+uint32_t
+pat_pte_bits(int memtype)
+{
+	switch (memtype) {
+	case MT_WB:
+		return 0;
+	case MT_WC:
+		return have_pat ? PTE_PWT : PTE_PCD;
+	case MT_UCMINUS:
+		return PTE_PCD;
+	case MT_WT:
+		return have_pat ? PTE_PAT | PTE_PCD | PTE_PWT : PTE_PWT;
+	case MT_WP:
+		return have_pat ? PTE_PAT | PTE_PWT : PTE_PCD | PTE_PWT;
+	default:
+		return PTE_PCD | PTE_PWT;
+	}
+}
+
+// Make [base, top) write-back with variable-range MTRRs, each a
+// power of two in size and aligned to it, largest first.  Only whole
+// pages are covered.
+static void
+mtrr_cover_range(uint64_t base, uint64_t top)
+{
+	uint64_t size;
+
+	base = ROUNDUP(base, PGSIZE);
+	top = ROUNDDOWN(top, PGSIZE);
+	for (; base < top && mtrr_var.next < mtrr_var.nvar; base += size) {
+		for (size = mtrr_var.addrmask + 1;
+		     (base & (size - 1)) || base + size > top; size >>= 1)
+			/* do nothing */;
+		wrmsr(MSR_MTRR_PHYSBASE(mtrr_var.next), base | MT_WB);
+		wrmsr(MSR_MTRR_PHYSMASK(mtrr_var.next),
+		      (~(size - 1) & mtrr_var.addrmask) | MTRR_VALID);
+		mtrr_var.next++;
+	}
+	if (base < top)
+		mtrr_var.missed += top - base;
+}
+
+// Note that [start, end) is RAM, to be made write-back.  RAM ranges
+// that touch are covered as one, which takes fewer MTRRs.  When the
+// fixed ranges are on, they decide the types below 1MB, so RAM there
+// and RAM from 1MB up are covered as one range as well.
+static void
+mtrr_cover(physaddr_t start, physaddr_t end)
+{
+	if (mtrr_var.end >= start)
+		mtrr_var.end = MAX(mtrr_var.end, (uint64_t) end);
+	else {
+		mtrr_cover_range(mtrr_var.start, mtrr_var.end);
+		mtrr_var.start = start;
+		mtrr_var.end = end;
+	}
+}
+
+// Program the MTRRs from scratch: RAM write-back, everything else
+// (device memory, the VGA window) uncacheable, the BIOS ROMs
+// write-protected.  Caching must be off.
+static void
+mtrr_program(void)
+{
+	uint64_t cap;
+	uint32_t eax, i;
+
+	cap = rdmsr(MSR_MTRRCAP);
+	mtrr_var.nvar = cap & MTRRCAP_VCNT;
+	mtrr_var.next = 0;
+	mtrr_var.missed = 0;
+	mtrr_var.start = 0;
+	mtrr_var.end = (cap & MTRRCAP_FIX) ? EXTPHYSMEM : 0;
+
+	// the PHYSMASK registers are as wide as physical addresses
+	mtrr_var.addrmask = (1ULL << 36) - 1;
+	cpuid(0x80000000, &eax, 0, 0, 0);
+	if (eax >= 0x80000008) {
+		cpuid(0x80000008, &eax, 0, 0, 0);
+		mtrr_var.addrmask = (1ULL << (eax & 0xFF)) - 1;
+	}
+
+	if (cap & MTRRCAP_FIX) {
+		wrmsr(MSR_MTRRFIX64K_00000, MTRR_FIX(MT_WB));
+		wrmsr(MSR_MTRRFIX16K_80000, MTRR_FIX(MT_WB));
+		wrmsr(MSR_MTRRFIX16K_A0000, MTRR_FIX(MT_UC));
+		for (i = 0; i < 8; i++)
+			wrmsr(MSR_MTRRFIX4K_C0000 + i, MTRR_FIX(MT_WP));
+	}
+
+	// Only the ranges the firmware reported as RAM are write-back;
+	// the holes between them, such as the PCI hole below 4GB, keep
+	// the uncacheable default.
+	memblock_foreach_memory(mtrr_cover);
+	mtrr_cover_range(mtrr_var.start, mtrr_var.end);
+	if (mtrr_var.missed)
+		cprintf("MTRR: %lluK of RAM left uncached\n",
+			mtrr_var.missed / 1024);
+	for (i = mtrr_var.next; i < mtrr_var.nvar; i++)
+		wrmsr(MSR_MTRR_PHYSMASK(i), 0);
+
+	wrmsr(MSR_MTRR_DEF_TYPE, MTRR_DEF_E
+	      | ((cap & MTRRCAP_FIX) ? MTRR_DEF_FE : 0) | MT_UC);
+}
+
+// Load our PAT, and set up the MTRRs if the firmware left them off.
+// MTRRs the firmware did set up are left alone: it knows where the
+// chipset puts device memory.
+void
+pat_init(void)
+{
+	uint32_t edx, cr0;
+	bool do_mtrr;
+
+	cpuid(1, 0, 0, 0, &edx);
+	have_pat = (edx & CPUID_PAT) != 0;
+	do_mtrr = (edx & CPUID_MTRR)
+		&& !(rdmsr(MSR_MTRR_DEF_TYPE) & MTRR_DEF_E);
+	cprintf("Memory types: PAT %s, MTRRs %s\n",
+		have_pat ? "loaded" : "not supported",
+		!(edx & CPUID_MTRR) ? "not supported"
+		: do_mtrr ? "programmed" : "set by firmware");
+	if (!have_pat && !do_mtrr)
+		return;
+
+	// The processor manuals' recipe: with caching off and the caches
+	// and TLB empty, no line can be cached under its old type.
+	// Interrupts are off already.
+	cr0 = rcr0();
+	lcr0((cr0 | CR0_CD) & ~CR0_NW);
+	wbinvd();
+	tlbflush_global();
+
+	if (do_mtrr)
+		mtrr_program();
+	if (have_pat)
+		wrmsr(MSR_PAT, PAT_VALUE);
+
+	wbinvd();
+	tlbflush_global();
+	lcr0(cr0);
+}
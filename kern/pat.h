@@ -0,0 +1,22 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_PAT_H
+#define JOS_KERN_PAT_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// Memory types, with the encodings the PAT and the MTRRs use
+#define MT_UC		0	// uncacheable
+#define MT_WC		1	// write-combining
+#define MT_WT		4	// write-through
+#define MT_WP		5	// write-protected
+#define MT_WB		6	// write-back
+#define MT_UCMINUS	7	// uncacheable, unless an MTRR says WC
+
+void		pat_init(void);
+uint32_t	pat_pte_bits(int memtype);
+
+#endif /* !JOS_KERN_PAT_H */
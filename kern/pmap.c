@@ -0,0 +1,1111 @@
+/* See COPYRIGHT for copyright information. */
+
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/error.h>
+#include <inc/string.h>
+#include <inc/assert.h>
+#include <inc/bootinfo.h>
+
+#include <kern/pmap.h>
+#include <kern/kclock.h>
+#include <kern/cpu.h>
+#include <kern/memblock.h>
+#include <kern/pat.h>
+
+// These variables are set by i386_detect_memory()
+static uint64_t maxpa;		// Maximum physical address
+size_t npage;			// Amount of physical memory (in pages)
+static uint64_t basemem;	// Amount of base memory (in bytes)
+static uint64_t extmem;		// Amount of extended memory (in bytes)
+static uint64_t highmem;	// Amount of it above MAXKPA (in bytes)
+
+// These variables are set in page_init()
+struct Page *pages;		// Virtual address of physical page array
+static struct Page_link *page_links;	// List links, indexed like pages
+static struct Page_list page_free_list[MAXNODE][NZONE][NORDER];	// Free blocks
+size_t node_npage[MAXNODE];	// Pages given to the allocator, by node
+struct Pcache pcache[NCPU];	// Per-CPU caches of free single pages
+struct Zpool zpool;		// Free pages zeroed ahead of time
+
+// Page colouring, set up by page_colour_init()
+struct Cachegeom l2geom;	// The L2 cache, as CPUID describes it
+uint32_t ncolour = 1;		// Page colours, a power of two
+static int colour_order;	// log2(ncolour)
+static struct Page_list colour_list[MAXCOLOUR];	// Free pages, by colour
+static uint32_t colour_count;	// Pages on the colour lists
+static uint32_t colour_next;	// Colour page_alloc_spread() hands out next
+
+// A batch of TLB invalidations bigger than this is done as one flush
+uint32_t tlb_invlpg_max = 32;
+struct Tlbstats tlbstats;
+
+// PTE_NX if the CPU has the no-execute bit and it is on, otherwise 0:
+// where it is off, the bit is reserved and must not be set.
+static pte_t pte_nx;
+
+// Temporary mappings in [KMAPBASE, KMAPLIM), for kmap()
+#define NKMAP		(PTSIZE / PGSIZE)
+static uint8_t kmap_used[NKMAP];	// slots in use
+static uint32_t kmap_next;		// slot to try first
+
+// RAM past what physaddr_t can address is ignored: with PAE, 52-bit
+// physical addresses, and without it, 32-bit ones.
+#ifdef JOS_PAE
+#define MAXPHYSMEM	(1ULL << 52)
+#else
+#define MAXPHYSMEM	0xFFFFF000ULL
+#endif
+
+// The page structures and list links all live below MAXKPA; memory
+// past what a quarter of that can describe is ignored.
+#define MAXNPAGE	((MAXKPA / 4) / (sizeof(struct Page) + sizeof(struct Page_link)))
+
+static int
+nvram_read(int r)
+{
+	return mc146818_read(r) | (mc146818_read(r + 1) << 8);
+}
+
+// Make up a memory map from the sizes CMOS records, for when neither
+// the boot loader nor a multiboot loader could provide one.
+static void
+cmos_mmap(void)
+{
+	uint64_t ext;
+
+	ext = nvram_read(NVRAM_EXTLO) * 1024ULL;
+	if (nvram_read(NVRAM_EXT16LO))
+		ext = (16 << 20) - EXTPHYSMEM
+			+ nvram_read(NVRAM_EXT16LO) * 65536ULL;
+
+	bootinfo.bi_mmap[0].e820_addr = 0;
+	bootinfo.bi_mmap[0].e820_len = nvram_read(NVRAM_BASELO) * 1024ULL;
+	bootinfo.bi_mmap[0].e820_type = E820_RAM;
+	bootinfo.bi_mmap[1].e820_addr = EXTPHYSMEM;
+	bootinfo.bi_mmap[1].e820_len = ext;
+	bootinfo.bi_mmap[1].e820_type = E820_RAM;
+	bootinfo.bi_nmmap = 2;
+}
+
+static const char *
+e820_type_name(uint32_t type)
+{
+	static const char * const names[] = {
+		[E820_RAM] = "usable",
+		[E820_RESERVED] = "reserved",
+		[E820_ACPI] = "ACPI data",
+		[E820_NVS] = "ACPI NVS",
+		[E820_BAD] = "unusable",
+	};
+
+	if (type < sizeof(names)/sizeof(names[0]) && names[type])
+		return names[type];
+	return "reserved";
+}
+
+// Find out where the physical memory is, from the memory map in
+// bootinfo: E820's from our boot loader or a multiboot loader's, or
+// failing those, one made up from CMOS.  The RAM it reports is handed
+// to memblock, less what is already in use.
+void
+i386_detect_memory(void)
+{
+	extern char end[];
+	struct E820 *e, *ee;
+	uint64_t start, stop;
+
+	// boot.S fills in the map through these offsets
+	static_assert(offsetof(struct Bootinfo, bi_nmmap) == BI_MMAPCNT);
+	static_assert(offsetof(struct Bootinfo, bi_tsc) == BI_TSC);
+	static_assert(offsetof(struct Bootinfo, bi_mmap) == BI_MMAP);
+	static_assert(sizeof(struct E820) == E820_SIZE);
+
+	if (bootinfo.bi_nmmap == 0)
+		cmos_mmap();
+
+	cprintf("Physical memory map:\n");
+	ee = bootinfo.bi_mmap + MIN(bootinfo.bi_nmmap, BI_NMMAP);
+	for (e = bootinfo.bi_mmap; e < ee; e++) {
+		cprintf("  %016llx-%016llx %s\n", e->e820_addr,
+			e->e820_addr + e->e820_len - 1,
+			e820_type_name(e->e820_type));
+
+		// BIOSes report overlapping ranges, and the more restrictive
+		// type wins, so any page a non-RAM range touches is reserved.
+		if (e->e820_type != E820_RAM) {
+			start = e->e820_addr & ~(uint64_t) (PGSIZE - 1);
+			stop = e->e820_addr + e->e820_len + PGSIZE - 1;
+			stop = MIN(stop & ~(uint64_t) (PGSIZE - 1), MAXPHYSMEM);
+			if (start < stop)
+				memblock_reserve(start, stop - start);
+			continue;
+		}
+
+		// whole pages only, and only below MAXPHYSMEM
+		start = (e->e820_addr + PGSIZE - 1) & ~(uint64_t) (PGSIZE - 1);
+		stop = MIN(e->e820_addr + e->e820_len, MAXPHYSMEM);
+		stop &= ~(uint64_t) (PGSIZE - 1);
+		if (start >= stop)
+			continue;
+		if (stop <= IOPHYSMEM)
+			basemem += stop - start;
+		else
+			extmem += stop - start;
+		if (stop > MAXKPA)
+			highmem += stop - MAX(start, MAXKPA);
+		maxpa = MAX(maxpa, stop);
+		memblock_add(start, stop - start);
+	}
+	if (maxpa == 0)
+		panic("i386_detect_memory: no usable memory");
+
+	if (maxpa / PGSIZE > MAXNPAGE) {
+		cprintf("Ignoring physical memory above %lluM\n",
+			((uint64_t) MAXNPAGE * PGSIZE) >> 20);
+		maxpa = (uint64_t) MAXNPAGE * PGSIZE;
+	}
+	npage = maxpa / PGSIZE;
+
+	// Memory that is in use already:
+	//  - physical page 0, which holds the real-mode IDT and BIOS data;
+	//  - the IO hole [IOPHYSMEM, EXTPHYSMEM), even if some BIOS says
+	//    otherwise;
+	//  - the kernel image, boot stack included, which the boot loader
+	//    put at EXTPHYSMEM.  'end' is a magic symbol the linker
+	//    places right after the kernel's bss segment.
+	memblock_reserve(0, PGSIZE);
+	memblock_reserve(IOPHYSMEM, EXTPHYSMEM - IOPHYSMEM);
+	memblock_reserve(EXTPHYSMEM, PADDR(end) - EXTPHYSMEM);
+
+	cprintf("Physical memory: %lluK available, ", maxpa / 1024);
+	cprintf("base = %lluK, extended = %lluK\n", basemem / 1024, extmem / 1024);
+	if (highmem)
+		cprintf("  of which %lluK is high memory, above %uM\n",
+			highmem / 1024, (uint32_t) (MAXKPA >> 20));
+}
+
+// This simple physical memory allocator is used only while JOS is setting
+// up its virtual memory system.  page_alloc() is the real allocator.
+//
+// Allocate n bytes of physical memory aligned on an
+// align-byte boundary.  Align must be a power of two.
+// Return kernel virtual address.  Returned memory is uninitialized.
+//
+// If we're out of memory, boot_alloc should panic.
+// This function may ONLY be used during initialization,
+// after i386_detect_memory() and before page_init() has handed
+// the remaining memory to the page allocator.
+static void*
+boot_alloc(uint32_t n, uint32_t align)
+{
+	physaddr_t pa;
+
+	if ((pa = memblock_alloc(n, align)) == 0)
+		panic("boot_alloc: out of memory");
+	return KADDR(pa);
+}
+
+// --------------------------------------------------------------
+// Tracking of physical pages.
+//
+// Free memory is kept by a binary buddy allocator.  page_free_list[n][z][k]
+// holds node n's free blocks of 2^k pages in zone z; a block always starts at a page
+// number that is a multiple of its size, so the block it pairs with
+// (its buddy) is found by flipping bit k of its page number.  Freeing
+// a block merges it with its buddy, and that pair with its own buddy,
+// as long as they are free; allocating splits a larger block in halves
+// until it has the size asked for.  Either takes O(MAXORDER) steps.
+//
+// Single pages, by far the most common request, usually come from and
+// go back to a small per-CPU cache in front of the buddy lists, which
+// only each CPU itself touches.  The buddy lists are visited only
+// when a cache runs empty or overflows, and then for a whole batch of
+// pages (see PCACHE_LOW and PCACHE_HIGH in pmap.h).
+//
+// Pages that must start out zeroed come from yet another list, the zero
+// pool, which page_zero_idle() fills with pages zeroed while the CPU
+// would otherwise just wait.  Pages are freed dirty, never to the pool.
+//
+// Callers that care which L2 cache sets their pages use can ask for a
+// page of a given colour, or with page_alloc_spread() for each colour
+// in turn.  Those come from per-colour lists, refilled a block of
+// ncolour pages at a time: such a block holds one page of each colour.
+//
+// Physical memory past MAXKPA is not mapped at KERNBASE, so its pages
+// have no kernel virtual address (page2kva() panics).  They are kept
+// apart, in ZONE_HIGH, and only handed out to callers that pass
+// ALLOC_HIGH to page_alloc() and use kmap() to get at the contents.
+// All of the caches above hold ZONE_NORMAL pages.
+//
+// On a NUMA machine, each node's memory is on lists of its own.  Blocks
+// are taken from the running CPU's node if it has one, and otherwise
+// from the other nodes, nearest first (see kern/numa.c).  A block never
+// spans two nodes.
+// --------------------------------------------------------------
+
+// Find the L2 cache's geometry with CPUID, and from it how many page
+// colours there are: the pages that fit in one way of the cache.
+static void
+page_colour_init(void)
+{
+	// associativity codes of AMD's CPUID 0x80000006
+	static const uint8_t amd_ways[16] = {
+		0, 1, 2, 0, 4, 0, 8, 0, 16, 0, 32, 48, 64, 96, 128, 0
+	};
+	uint32_t maxleaf, eax, ebx, ecx, n, i;
+
+	// Intel: deterministic cache parameters, one subleaf per cache
+	cpuid(0, &maxleaf, 0, 0, 0);
+	for (i = 0; maxleaf >= 4; i++) {
+		cpuid_count(4, i, &eax, &ebx, &ecx, 0);
+		if ((eax & 0x1F) == 0)		// no more caches
+			break;
+		if (((eax >> 5) & 7) == 2 && (eax & 0x1F) != 2) {
+			l2geom.cg_ways = (ebx >> 22) + 1;
+			l2geom.cg_line = (ebx & 0xFFF) + 1;
+			l2geom.cg_size = l2geom.cg_ways * l2geom.cg_line
+				* (((ebx >> 12) & 0x3FF) + 1) * (ecx + 1);
+			break;
+		}
+	}
+
+	// AMD: L2 size and associativity in one register
+	if (l2geom.cg_size == 0) {
+		cpuid(0x80000000, &maxleaf, 0, 0, 0);
+		if (maxleaf >= 0x80000006) {
+			cpuid(0x80000006, 0, 0, &ecx, 0);
+			l2geom.cg_size = (ecx >> 16) * 1024;
+			l2geom.cg_ways = amd_ways[(ecx >> 12) & 0xF];
+			l2geom.cg_line = ecx & 0xFF;
+		}
+	}
+
+	// A fully associative cache (or one we know nothing of) has
+	// only one colour.
+	ncolour = 1;
+	if (l2geom.cg_size && l2geom.cg_ways) {
+		n = l2geom.cg_size / l2geom.cg_ways / PGSIZE;
+		while (ncolour * 2 <= MIN(n, MAXCOLOUR))
+			ncolour *= 2;
+	}
+	for (colour_order = 0; (1 << colour_order) < ncolour; colour_order++)
+		/* do nothing */;
+}
+
+// Turn on the no-execute bit, if paging has one and the CPU knows it
+// (CPUID 0x80000001, EDX bit 20).
+static void
+nx_init(void)
+{
+#ifdef JOS_PAE
+	uint32_t maxleaf, edx;
+
+	cpuid(0x80000000, &maxleaf, 0, 0, 0);
+	if (maxleaf < 0x80000001)
+		return;
+	cpuid(0x80000001, 0, 0, 0, &edx);
+	if (!(edx & (1 << 20)))
+		return;
+	wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_NXE);
+	pte_nx = PTE_NX;
+#endif
+}
+
+// Lists of pages.  They are doubly linked through page_links[] by page
+// number, so a page is taken off a list without walking it, but its
+// struct Page holds nothing but the fields scans look at.
+
+static void
+plist_init(struct Page_list *l)
+{
+	l->pl_first = NOPAGE;
+}
+
+static bool
+plist_empty(struct Page_list *l)
+{
+	return l->pl_first == NOPAGE;
+}
+
+static struct Page *
+plist_first(struct Page_list *l)
+{
+	return l->pl_first == NOPAGE ? NULL : &pages[l->pl_first];
+}
+
+static void
+plist_insert_head(struct Page_list *l, struct Page *pp)
+{
+	ppn_t ppn = page2ppn(pp);
+
+	page_links[ppn].pl_next = l->pl_first;
+	page_links[ppn].pl_prev = NOPAGE;
+	if (l->pl_first != NOPAGE)
+		page_links[l->pl_first].pl_prev = ppn;
+	l->pl_first = ppn;
+}
+
+static void
+plist_remove(struct Page_list *l, struct Page *pp)
+{
+	struct Page_link *pl = &page_links[page2ppn(pp)];
+
+	if (pl->pl_prev == NOPAGE)
+		l->pl_first = pl->pl_next;
+	else
+		page_links[pl->pl_prev].pl_next = pl->pl_next;
+	if (pl->pl_next != NOPAGE)
+		page_links[pl->pl_next].pl_prev = pl->pl_prev;
+}
+
+// Whether a NUMA range begins or ends inside pages [ppn, eppn), so
+// that they may not all be on one node.
+static bool
+numa_split(ppn_t ppn, ppn_t eppn)
+{
+	physaddr_t lo = (physaddr_t) ppn << PGSHIFT;
+	physaddr_t hi = (physaddr_t) eppn << PGSHIFT;
+	struct Numarange *nr;
+
+	for (nr = numa_range; nr < numa_range + nnumarange; nr++)
+		if ((nr->nr_base > lo && nr->nr_base < hi)
+		    || (nr->nr_end > lo && nr->nr_end < hi))
+			return 1;
+	return 0;
+}
+
+// Free the pages in [start, end), as the largest blocks that fit on
+// one node, so the range goes onto the free lists already merged.
+static void
+page_free_range(physaddr_t start, physaddr_t end)
+{
+	ppn_t ppn, eppn;
+	int order;
+
+	ppn = PPN(start + PGSIZE - 1);
+	eppn = MIN(PPN(end), npage);
+	while (ppn < eppn) {
+		for (order = MAXORDER; order > 0; order--)
+			if ((ppn & ((1 << order) - 1)) == 0
+			    && ppn + (1 << order) <= eppn
+			    && !numa_split(ppn, ppn + (1 << order)))
+				break;
+		node_npage[page2node(&pages[ppn])] += 1 << order;
+		page_free_order(&pages[ppn], order);
+		ppn += 1 << order;
+	}
+}
+
+//
+// Initialize the page structures and free lists.
+// After this point, ONLY use the functions below
+// to allocate and deallocate physical memory via the page_free_list,
+// and NEVER use boot_alloc()
+//
+void
+page_init(void)
+{
+	struct Numarange *nr;
+	size_t i, j, k;
+	ppn_t ppn;
+
+	pages = boot_alloc(npage * sizeof(struct Page), PGSIZE);
+	memset(pages, 0, npage * sizeof(struct Page));
+	page_links = boot_alloc(npage * sizeof(struct Page_link), PGSIZE);
+
+	// Memory the SRAT does not mention stays on node 0.
+	for (nr = numa_range; nr < numa_range + nnumarange; nr++)
+		for (ppn = PPN(nr->nr_base); ppn < MIN(PPN(nr->nr_end), npage);
+		     ppn++)
+			pages[ppn].pp_flags = nr->nr_node << PP_NODESHIFT;
+
+	for (i = 0; i < MAXNODE; i++)
+		for (j = 0; j < NZONE; j++)
+			for (k = 0; k < NORDER; k++)
+				plist_init(&page_free_list[i][j][k]);
+	for (i = 0; i < NCPU; i++)
+		plist_init(&pcache[i].pc_list);
+	plist_init(&zpool.zp_list);
+	for (i = 0; i < MAXCOLOUR; i++)
+		plist_init(&colour_list[i]);
+	page_colour_init();
+	nx_init();
+
+	// Take over everything memblock has not handed out.
+	memblock_foreach_free(page_free_range);
+
+	// The free lists are ready; idle time can be spent zeroing.
+	zpool.zp_idle = 1;
+}
+
+// Take a free block of 2^order pages of 'zone' on 'node' off the buddy
+// lists, splitting a larger one if need be.  Returns NULL if there is
+// none.
+static struct Page *
+buddy_alloc_node(int node, int zone, int order)
+{
+	struct Page_list *fl = page_free_list[node][zone];
+	struct Page *pp;
+	int k;
+
+	// smallest free block that is large enough
+	for (k = order; k <= MAXORDER; k++)
+		if (!plist_empty(&fl[k]))
+			break;
+	if (k > MAXORDER)
+		return NULL;
+	pp = plist_first(&fl[k]);
+	plist_remove(&fl[k], pp);
+	pp->pp_flags &= ~PP_FREE;
+
+	// give back the upper half until the block is the right size
+	while (k > order) {
+		k--;
+		pp[1 << k].pp_order = k;
+		pp[1 << k].pp_flags |= PP_FREE;
+		plist_insert_head(&fl[k], &pp[1 << k]);
+	}
+	pp->pp_order = order;
+	return pp;
+}
+
+// Take a free block of 2^order pages of 'zone' off the buddy lists,
+// from the nearest node that has one.  Returns NULL if there is none.
+static struct Page *
+buddy_alloc(int zone, int order)
+{
+	const uint8_t *fallback = node_fallback[numa_node()];
+	struct Page *pp;
+	int i;
+
+	for (i = 0; i < nnode; i++)
+		if ((pp = buddy_alloc_node(fallback[i], zone, order)) != NULL)
+			return pp;
+	return NULL;
+}
+
+// Take a page off the zero pool, which must not be empty.
+static int
+zpool_take(struct Page **pp_store)
+{
+	struct Page *pp;
+
+	pp = plist_first(&zpool.zp_list);
+	plist_remove(&zpool.zp_list, pp);
+	pp->pp_flags &= ~PP_ZERO;
+	zpool.zp_count--;
+	*pp_store = pp;
+	return 0;
+}
+
+// Give all of the zero pool back to the buddy lists.
+static void
+zpool_drain(void)
+{
+	struct Page *pp;
+
+	while ((pp = plist_first(&zpool.zp_list)) != NULL) {
+		plist_remove(&zpool.zp_list, pp);
+		pp->pp_flags &= ~PP_ZERO;
+		zpool.zp_count--;
+		page_free_order(pp, 0);
+	}
+}
+
+// Take a page off the colour lists, of whatever colour there is.
+static int
+colour_take(struct Page **pp_store)
+{
+	uint32_t c;
+
+	for (c = 0; plist_empty(&colour_list[c]); c++)
+		/* do nothing */;
+	return page_alloc_colour(c, pp_store);
+}
+
+// Give all the pages on the colour lists back to the buddy lists.
+static void
+colour_drain(void)
+{
+	struct Page *pp;
+	uint32_t c;
+
+	for (c = 0; c < ncolour; c++)
+		while ((pp = plist_first(&colour_list[c])) != NULL) {
+			plist_remove(&colour_list[c], pp);
+			pp->pp_flags &= ~PP_COLOUR;
+			colour_count--;
+			page_free_order(pp, 0);
+		}
+}
+
+//
+// Allocate a block of 2^order physically contiguous pages, aligned to
+// its size, and store its first page in *pp_store.  The Page
+// structures of the block are not initialized, nor is the memory.
+// The block is always below MAXKPA.
+//
+// RETURNS
+//   0 -- on success
+//   -E_NO_MEM -- otherwise
+//
+int
+page_alloc_order(int order, struct Page **pp_store)
+{
+	struct Page *pp;
+
+	if (order < 0 || order > MAXORDER)
+		return -E_NO_MEM;
+
+	// Pages sitting in this CPU's cache, the zero pool or the
+	// colour lists may complete a block.
+	if ((pp = buddy_alloc(ZONE_NORMAL, order)) == NULL
+	    && (pcache[cpunum()].pc_count > 0 || zpool.zp_count > 0
+		|| colour_count > 0)) {
+		pcache_drain(&pcache[cpunum()], 0);
+		zpool_drain();
+		colour_drain();
+		pp = buddy_alloc(ZONE_NORMAL, order);
+	}
+	if (pp == NULL)
+		return -E_NO_MEM;
+	*pp_store = pp;
+	return 0;
+}
+
+//
+// Like page_alloc_order(), but the block is on NUMA node 'node', and
+// only comes from the buddy lists.  If 'alloc_flags' has ALLOC_HIGH
+// set, the block may be one of high memory, as with page_alloc(); a
+// node may have nothing else.
+//
+int
+page_alloc_node(int node, int order, int alloc_flags, struct Page **pp_store)
+{
+	struct Page *pp;
+
+	if (node < 0 || node >= nnode || order < 0 || order > MAXORDER)
+		return -E_NO_MEM;
+	if ((!(alloc_flags & ALLOC_HIGH)
+	     || (pp = buddy_alloc_node(node, ZONE_HIGH, order)) == NULL)
+	    && (pp = buddy_alloc_node(node, ZONE_NORMAL, order)) == NULL)
+		return -E_NO_MEM;
+	*pp_store = pp;
+	return 0;
+}
+
+//
+// Return the block of 2^order pages starting at pp to the free lists.
+// (This function should only be called when pp->pp_ref reaches 0.)
+//
+void
+page_free_order(struct Page *pp, int order)
+{
+	struct Page_list *fl = page_free_list[page2node(pp)][page2zone(pp)];
+	struct Page *buddy;
+	ppn_t ppn, bppn;
+
+	if (pp->pp_flags & (PP_FREE | PP_CACHED | PP_ZERO | PP_COLOUR))
+		panic("page_free_order: page %llx already free",
+		      (uint64_t) page2pa(pp));
+
+	ppn = page2ppn(pp);
+	for (; order < MAXORDER; order++) {
+		bppn = ppn ^ (1 << order);
+		if (bppn >= npage)
+			break;
+		buddy = &pages[bppn];
+		if (!(buddy->pp_flags & PP_FREE) || buddy->pp_order != order
+		    || page2node(buddy) != page2node(pp))
+			break;
+		plist_remove(&fl[order], buddy);
+		buddy->pp_flags &= ~PP_FREE;
+		ppn &= ~(1 << order);
+	}
+
+	pp = &pages[ppn];
+	pp->pp_order = order;
+	pp->pp_flags |= PP_FREE;
+	plist_insert_head(&fl[order], pp);
+}
+
+//
+// Allocates a physical page.
+// Does NOT set the contents of the physical page to zero unless
+// 'alloc_flags' has ALLOC_ZERO set, in which case a page from the
+// zero pool is used if there is one.
+// If 'alloc_flags' has ALLOC_HIGH set, the page may be one of high
+// memory, which has no kernel virtual address; high pages are used
+// first, to leave the others to callers that need them.
+//
+// *pp_store -- is set to point to the Page struct of the newly allocated
+// page
+//
+// RETURNS
+//   0 -- on success
+//   -E_NO_MEM -- otherwise
+//
+int
+page_alloc(struct Page **pp_store, int alloc_flags)
+{
+	struct Pcache *pc = &pcache[cpunum()];
+	struct Page *pp;
+	void *va;
+
+	if ((alloc_flags & ALLOC_HIGH)
+	    && (pp = buddy_alloc(ZONE_HIGH, 0)) != NULL) {
+		if (alloc_flags & ALLOC_ZERO) {
+			va = kmap(pp);
+			memset(va, 0, PGSIZE);
+			kunmap(va);
+		}
+		*pp_store = pp;
+		return 0;
+	}
+
+	if ((alloc_flags & ALLOC_ZERO) && zpool.zp_count > 0) {
+		zpool.zp_hits++;
+		return zpool_take(pp_store);
+	}
+
+	if (pc->pc_count == 0) {
+		pc->pc_misses++;
+		// take a batch from the buddy lists
+		while (pc->pc_count < PCACHE_LOW
+		       && (pp = buddy_alloc(ZONE_NORMAL, 0)) != NULL) {
+			pp->pp_flags |= PP_CACHED;
+			plist_insert_head(&pc->pc_list, pp);
+			pc->pc_count++;
+		}
+		if (pc->pc_count == 0) {
+			// pages kept for other uses are better than none
+			if (zpool.zp_count > 0)
+				return zpool_take(pp_store);
+			if (colour_count > 0)
+				return colour_take(pp_store);
+			return -E_NO_MEM;
+		}
+		pc->pc_refills++;
+	} else
+		pc->pc_hits++;
+
+	pp = plist_first(&pc->pc_list);
+	plist_remove(&pc->pc_list, pp);
+	pp->pp_flags &= ~PP_CACHED;
+	pc->pc_count--;
+	if (alloc_flags & ALLOC_ZERO) {
+		zpool.zp_misses++;
+		memset(page2kva(pp), 0, PGSIZE);
+	}
+	*pp_store = pp;
+	return 0;
+}
+
+//
+// Allocate a physical page of the given colour (taken modulo ncolour),
+// if there is one; otherwise, any page.  See page_alloc() for the
+// return value.
+//
+int
+page_alloc_colour(uint32_t colour, struct Page **pp_store)
+{
+	struct Page_list *l;
+	struct Page *pp;
+	uint32_t c;
+
+	colour &= ncolour - 1;
+	l = &colour_list[colour];
+	if (plist_empty(l)) {
+		// an aligned block of ncolour pages has one of each colour
+		if ((pp = buddy_alloc(ZONE_NORMAL, colour_order)) == NULL)
+			return page_alloc(pp_store, 0);
+		for (c = 0; c < ncolour; c++) {
+			pp[c].pp_order = 0;
+			pp[c].pp_flags |= PP_COLOUR;
+			plist_insert_head(&colour_list[c], &pp[c]);
+		}
+		colour_count += ncolour;
+	}
+
+	pp = plist_first(l);
+	plist_remove(l, pp);
+	pp->pp_flags &= ~PP_COLOUR;
+	colour_count--;
+	*pp_store = pp;
+	return 0;
+}
+
+//
+// Allocate a physical page, of the colour after the one the previous
+// call returned, so that pages allocated one after the other spread
+// evenly over the L2 cache.  See page_alloc() for the return value.
+//
+int
+page_alloc_spread(struct Page **pp_store)
+{
+	return page_alloc_colour(colour_next++, pp_store);
+}
+
+//
+// Return a page to the free list.
+// (This function should only be called when pp->pp_ref reaches 0.)
+//
+void
+page_free(struct Page *pp)
+{
+	struct Pcache *pc = &pcache[cpunum()];
+
+	if (pp->pp_flags & (PP_FREE | PP_CACHED | PP_ZERO | PP_COLOUR))
+		panic("page_free: page %llx already free",
+		      (uint64_t) page2pa(pp));
+	if (page2zone(pp) == ZONE_HIGH) {
+		page_free_order(pp, 0);
+		return;
+	}
+	pp->pp_order = 0;
+	pp->pp_flags |= PP_CACHED;
+	plist_insert_head(&pc->pc_list, pp);
+	if (++pc->pc_count > PCACHE_HIGH)
+		pcache_drain(pc, PCACHE_LOW);
+}
+
+// Give pages from the cache 'pc' back to the buddy lists until only
+// 'keep' are left.
+void
+pcache_drain(struct Pcache *pc, uint32_t keep)
+{
+	struct Page *pp;
+
+	if (pc->pc_count <= keep)
+		return;
+	while (pc->pc_count > keep) {
+		pp = plist_first(&pc->pc_list);
+		plist_remove(&pc->pc_list, pp);
+		pp->pp_flags &= ~PP_CACHED;
+		pc->pc_count--;
+		page_free_order(pp, 0);
+	}
+	pc->pc_drains++;
+}
+
+// Zero one free page for the zero pool, unless it is full already.
+// This is meant to be called whenever the CPU is idle, so it does only
+// a page's worth of work at a time, not to delay whatever the CPU was
+// waiting for.  Returns 1 if it zeroed a page, 0 if there was nothing
+// to do, as it always is before page_init or after page_zero_stop.
+int
+page_zero_idle(void)
+{
+	struct Page *pp;
+
+	if (!zpool.zp_idle || zpool.zp_count >= ZPOOL_TARGET)
+		return 0;
+	// Straight from the buddy lists: emptying this CPU's cache to
+	// fill the pool would only cost a refill on the next page_alloc.
+	if ((pp = buddy_alloc(ZONE_NORMAL, 0)) == NULL)
+		return 0;
+	memset(page2kva(pp), 0, PGSIZE);
+	pp->pp_flags |= PP_ZERO;
+	plist_insert_head(&zpool.zp_list, pp);
+	zpool.zp_count++;
+	zpool.zp_zeroed++;
+	return 1;
+}
+
+// Stop page_zero_idle() from touching the free lists, which may be
+// half-updated: the kernel has panicked, perhaps in the allocator.
+void
+page_zero_stop(void)
+{
+	zpool.zp_idle = 0;
+}
+
+//
+// Decrement the reference count on a page,
+// freeing it if there are no more refs.
+//
+void
+page_decref(struct Page* pp)
+{
+	if (--pp->pp_ref == 0) {
+		if (pp->pp_order == 0)
+			page_free(pp);
+		else
+			page_free_order(pp, pp->pp_order);
+	}
+}
+
+// Return the number of free blocks of 2^order pages, in all zones
+// of all nodes.
+size_t
+page_free_blocks(int order)
+{
+	ppn_t ppn;
+	size_t n;
+	int node, zone;
+
+	n = 0;
+	for (node = 0; node < nnode; node++)
+		for (zone = 0; zone < NZONE; zone++)
+			for (ppn = page_free_list[node][zone][order].pl_first;
+			     ppn != NOPAGE; ppn = page_links[ppn].pl_next)
+				n++;
+	return n;
+}
+
+
+// --------------------------------------------------------------
+// Page tables.
+//
+// These work on the current address space through the recursive
+// mapping at VPT: vpd[] is the page directory and vpt[] the page tables
+// laid end to end, so the entry for virtual page N is vpt[N] (see
+// inc/memlayout.h).  With PAE, vpd[] is the four page directories laid
+// end to end; the page directory pointer table above them is set up
+// once by entry.S and never changes.  A directory entry with PTE_PS set
+// maps a large page (4MB, or 2MB with PAE) and has no page table behind
+// it; these functions leave such regions alone.
+//
+// Range operations collect the pages whose mappings they change in a
+// struct Tlbbatch and invalidate the TLB once at the end, so a large
+// range costs at most one flush rather than an invlpg, which
+// serializes the CPU, per page.
+// --------------------------------------------------------------
+
+// Return a pointer to the page table entry for 'va'.  If there is no
+// page table for it and 'create' is set, a zeroed page table is
+// allocated; otherwise NULL is returned.  Also returns NULL if 'va'
+// lies in a 4MB page.
+pte_t *
+pt_walk(uintptr_t va, int create)
+{
+	struct Page *pp;
+	pde_t pde;
+
+	pde = vpd[PDX(va)];
+	if (pde & PTE_PS)
+		return NULL;
+	if (!(pde & PTE_P)) {
+		if (!create || page_alloc(&pp, ALLOC_ZERO) < 0)
+			return NULL;
+		pp->pp_ref++;
+		vpd[PDX(va)] = page2pa(pp) | PTE_P | PTE_W | PTE_U;
+		// the new table's own page in vpt[]
+		invlpg((void *) &vpt[VPN(ROUNDDOWN(va, PTSIZE))]);
+	}
+	return (pte_t *) &vpt[VPN(va)];
+}
+
+// Map [va, va+size) to physical addresses [pa, pa+size) with
+// permissions 'perm' | PTE_P, allocating page tables as needed.
+// va, pa and size must be page-aligned.  PTE_NX in 'perm' is dropped
+// if the CPU does not have it.
+//
+// RETURNS
+//   0 -- on success
+//   -E_NO_MEM -- if a page table could not be allocated
+//   -E_INVAL -- if the range overlaps a 4MB page
+// On failure, the part of the range before the problem is mapped.
+int
+pt_map_range(uintptr_t va, physaddr_t pa, size_t size, pte_t perm)
+{
+	struct Tlbbatch tb;
+	size_t off;
+	pte_t *pte;
+	int r;
+
+	assert(PGOFF(va) == 0 && PGOFF(pa) == 0 && PGOFF(size) == 0);
+	perm &= ~PTE_NX | pte_nx;
+	tb.tb_n = 0;
+	tb.tb_global = 0;
+	r = 0;
+	for (off = 0; off < size; off += PGSIZE) {
+		if ((pte = pt_walk(va + off, 1)) == NULL) {
+			r = (vpd[PDX(va + off)] & PTE_PS) ? -E_INVAL : -E_NO_MEM;
+			break;
+		}
+		tlb_batch_add(&tb, va + off, *pte);
+		*pte = (pa + off) | perm | PTE_P;
+	}
+	tlb_batch_finish(&tb);
+	return r;
+}
+
+// Unmap [va, va+size), which must be page-aligned.  Page tables are
+// kept even when they end up empty.
+//
+// RETURNS
+//   0 -- on success
+//   -E_INVAL -- if the range overlaps a 4MB page, which is left as is
+int
+pt_unmap_range(uintptr_t va, size_t size)
+{
+	struct Tlbbatch tb;
+	uintptr_t end, next;
+	pte_t *pte;
+	int r;
+
+	assert(PGOFF(va) == 0 && PGOFF(size) == 0);
+	tb.tb_n = 0;
+	tb.tb_global = 0;
+	r = 0;
+	for (end = va + size; va < end; va = next) {
+		// one page table at a time; skip the missing ones whole
+		next = MIN(ROUNDDOWN(va, PTSIZE) + PTSIZE, end);
+		if (next == 0)		// wrapped past the top
+			next = end;
+		if (vpd[PDX(va)] & PTE_PS) {
+			r = -E_INVAL;
+			continue;
+		}
+		if (!(vpd[PDX(va)] & PTE_P))
+			continue;
+		for (pte = (pte_t *) &vpt[VPN(va)]; va < next; va += PGSIZE, pte++) {
+			tlb_batch_add(&tb, va, *pte);
+			*pte = 0;
+		}
+	}
+	tlb_batch_finish(&tb);
+	return r;
+}
+
+// Note that the mapping for 'va', which was 'old', has changed.
+// Only a present mapping can have a TLB entry to drop.
+void
+tlb_batch_add(struct Tlbbatch *tb, uintptr_t va, pte_t old)
+{
+	if (!(old & PTE_P))
+		return;
+	if (old & PTE_G)
+		tb->tb_global = 1;
+	if (tb->tb_n < TLBBATCH_MAX)
+		tb->tb_va[tb->tb_n] = va;
+	tb->tb_n++;
+}
+
+// Drop the stale TLB entries for the mappings in 'tb', and empty it.
+// Past tlb_invlpg_max pages, one full flush is taken to be cheaper than
+// an invlpg for each; the monitor's ptbench command shows where the
+// two cross over on this machine.
+void
+tlb_batch_finish(struct Tlbbatch *tb)
+{
+	uint32_t i;
+
+	if (tb->tb_n > MIN(tlb_invlpg_max, TLBBATCH_MAX)) {
+		if (tb->tb_global)
+			tlbflush_global();
+		else
+			tlbflush();
+		tlbstats.ts_flush++;
+	} else {
+		for (i = 0; i < tb->tb_n; i++)
+			invlpg((void *) tb->tb_va[i]);
+		tlbstats.ts_invlpg += tb->tb_n;
+	}
+	tb->tb_n = 0;
+	tb->tb_global = 0;
+}
+
+// Reserve 'size' bytes in the MMIO region and map physical addresses
+// [pa, pa+size) there, for the kernel only, with memory type
+// 'memtype' (see kern/pat.h).  Neither pa nor size need be
+// page-aligned.  Returns the virtual address of pa.
+void *
+mmio_map_region(physaddr_t pa, size_t size, int memtype)
+{
+	static uintptr_t base = MMIOBASE;
+	uintptr_t va;
+	size_t n;
+
+	n = ROUNDUP(PGOFF(pa) + size, PGSIZE);
+	if (base + n > MMIOLIM || base + n < base)
+		panic("mmio_map_region: out of MMIO space");
+	va = base;
+	if (pt_map_range(va, pa - PGOFF(pa), n,
+			 PTE_W | PTE_G | PTE_NX | pat_pte_bits(memtype)) < 0)
+		panic("mmio_map_region: out of memory");
+	base += n;
+	return (void *) (va + PGOFF(pa));
+}
+
+// Return a kernel virtual address for the page 'pp', which may be one
+// of high memory.  Pages below MAXKPA are just at their KERNBASE
+// address; others are mapped at a free slot of [KMAPBASE, KMAPLIM)
+// until kunmap() is called on the address, and should not be kept
+// longer than it takes to copy or clear them.
+void *
+kmap(struct Page *pp)
+{
+	physaddr_t pa = page2pa(pp);
+	uint32_t i, n;
+	uintptr_t va;
+
+	if (pa < MAXKPA)
+		return KADDR(pa);
+	for (n = 0; n < NKMAP; n++) {
+		i = (kmap_next + n) % NKMAP;
+		if (!kmap_used[i])
+			break;
+	}
+	if (n == NKMAP)
+		panic("kmap: out of temporary mappings");
+	va = KMAPBASE + i * PGSIZE;
+	if (pt_map_range(va, pa, PGSIZE, PTE_W | PTE_NX) < 0)
+		panic("kmap: out of memory");
+	kmap_used[i] = 1;
+	kmap_next = i + 1;
+	return (void *) va;
+}
+
+// Undo kmap(); 'va' is what it returned.
+void
+kunmap(void *va)
+{
+	uintptr_t a = (uintptr_t) va;
+
+	if (a >= KERNBASE)
+		return;
+	assert(a >= KMAPBASE && a < KMAPLIM && PGOFF(a) == 0);
+	pt_unmap_range(a, PGSIZE);
+	kmap_used[(a - KMAPBASE) / PGSIZE] = 0;
+}
+
+// Like kmap(), for the block of 2^order pages at 'pp', which must fit
+// in [KMAPBASE, KMAPLIM) whole.  A high block is mapped at KMAPBASE,
+// so returns NULL if it is too large, if kmap() has slots in use there,
+// or if a page table can not be had.
+void *
+kmap_block(struct Page *pp, int order)
+{
+	physaddr_t pa = page2pa(pp);
+	uint32_t i, n = 1 << order;
+
+	if (pa < MAXKPA)
+		return KADDR(pa);
+	if (n > NKMAP)
+		return NULL;
+	for (i = 0; i < n; i++)
+		if (kmap_used[i])
+			return NULL;
+	if (pt_map_range(KMAPBASE, pa, n * PGSIZE, PTE_W | PTE_NX) < 0) {
+		pt_unmap_range(KMAPBASE, n * PGSIZE);
+		return NULL;
+	}
+	memset(kmap_used, 1, n);
+	return (void *) KMAPBASE;
+}
+
+// Undo kmap_block(); 'va' is what it returned.
+void
+kunmap_block(void *va, int order)
+{
+	uintptr_t a = (uintptr_t) va;
+
+	if (a >= KERNBASE)
+		return;
+	assert(a == KMAPBASE);
+	pt_unmap_range(a, PGSIZE << order);
+	memset(kmap_used, 0, 1 << order);
+}
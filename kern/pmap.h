@@ -0,0 +1,214 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_PMAP_H
+#define JOS_KERN_PMAP_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/memlayout.h>
+#include <inc/assert.h>
+#include <kern/numa.h>
+
+/* This macro takes a kernel virtual address -- an address that points above
+ * KERNBASE, where the first 256MB of physical memory is mapped --
+ * and returns the corresponding physical address.  It panics if you pass it a
+ * non-kernel virtual address.
+ */
+#define PADDR(kva)						\
+({								\
+	uintptr_t __m_kva = (uintptr_t) (kva);			\
+	if (__m_kva < KERNBASE)					\
+		panic("PADDR called with invalid kva %08lx", __m_kva);\
+	(physaddr_t) (__m_kva - KERNBASE);			\
+})
+
+/* This macro takes a physical address and returns the corresponding kernel
+ * virtual address.  It panics if you pass an invalid physical address,
+ * including one of the high memory that is not mapped at KERNBASE (for
+ * which, see kmap()). */
+#define KADDR(pa)						\
+({								\
+	physaddr_t __m_pa = (pa);				\
+	ppn_t __m_ppn = PPN(__m_pa);				\
+	if (__m_ppn >= npage || __m_pa >= MAXKPA)		\
+		panic("KADDR called with invalid pa %llx", (uint64_t) __m_pa);\
+	(void*) (uintptr_t) (__m_pa + KERNBASE);		\
+})
+
+// Only physical addresses below MAXKPA are mapped at KERNBASE.
+#define MAXKPA		((physaddr_t) -KERNBASE)
+
+// A list of pages, doubly linked by page number through each page's
+// struct Page_link, which is kept apart from its struct Page.  A page
+// is on at most one list at a time.
+#define NOPAGE		((ppn_t) -1)
+
+struct Page_list {
+	ppn_t pl_first;			// first page, or NOPAGE
+};
+
+struct Page_link {
+	ppn_t pl_next;			// next page, or NOPAGE
+	ppn_t pl_prev;			// previous page, or NOPAGE
+};
+
+// The buddy allocator hands out blocks of 2^order pages, for orders
+// up to MAXORDER (4MB, the size of a PSE page).
+#define MAXORDER	10
+#define NORDER		(MAXORDER + 1)
+
+// Physical memory is split in zones, each with its own buddy lists:
+// ZONE_NORMAL, below MAXKPA, which the kernel reaches through KERNBASE,
+// and ZONE_HIGH, above it, which it only reaches through kmap().
+// MAXKPA is a multiple of the largest block, so no block is in both.
+// Each NUMA node has its own lists for each zone.
+#define ZONE_NORMAL	0
+#define ZONE_HIGH	1
+#define NZONE		2
+
+// Per-CPU cache of free single pages in front of the buddy allocator.
+// It is refilled up to PCACHE_LOW pages when it runs empty, and drained
+// back to PCACHE_LOW once it holds more than PCACHE_HIGH.
+#define PCACHE_LOW	16
+#define PCACHE_HIGH	64
+
+struct Pcache {
+	struct Page_list pc_list;	// cached free pages
+	uint32_t pc_count;		// number of pages on pc_list
+
+	// statistics
+	uint32_t pc_hits;		// allocations served from pc_list
+	uint32_t pc_misses;		// allocations that found it empty
+	uint32_t pc_refills;		// batches taken from the buddy lists
+	uint32_t pc_drains;		// batches given back to them
+};
+
+// Flags for page_alloc()
+#define ALLOC_ZERO	0x1	// zero the page's contents
+#define ALLOC_HIGH	0x2	// a high page will do (see kmap())
+
+// Free pages zeroed ahead of time, so that page_alloc(ALLOC_ZERO) need
+// not spend the time to zero one.  page_zero_idle() tops it up to
+// ZPOOL_TARGET pages when the CPU has nothing else to do.
+#define ZPOOL_TARGET	64
+
+struct Zpool {
+	struct Page_list zp_list;	// zeroed free pages
+	uint32_t zp_count;		// number of pages on zp_list
+	bool zp_idle;			// page_zero_idle() may take pages
+
+	// statistics
+	uint32_t zp_hits;		// ALLOC_ZERO allocations served from it
+	uint32_t zp_misses;		// ALLOC_ZERO allocations zeroed on the spot
+	uint32_t zp_zeroed;		// pages zeroed by page_zero_idle()
+};
+
+// Changes to page table entries are collected in a struct Tlbbatch and
+// their stale TLB entries dropped all at once: one invlpg per page, or
+// a whole TLB flush if more than tlb_invlpg_max pages changed.
+#define TLBBATCH_MAX	64
+
+struct Tlbbatch {
+	uint32_t tb_n;			// pages whose mappings changed
+	bool tb_global;			// some were global (PTE_G)
+	uintptr_t tb_va[TLBBATCH_MAX];	// the first TLBBATCH_MAX of them
+};
+
+struct Tlbstats {
+	uint32_t ts_invlpg;		// single pages invalidated
+	uint32_t ts_flush;		// whole TLB flushes
+};
+
+// Page colouring.  Pages whose physical addresses are a multiple of
+// ncolour pages apart land in the same sets of the L2 cache, so pages
+// of different colours (PPN modulo ncolour) never compete for a set.
+#define MAXCOLOUR	64
+
+struct Cachegeom {
+	uint32_t cg_size;		// bytes
+	uint32_t cg_ways;		// associativity
+	uint32_t cg_line;		// bytes per line
+};
+
+extern struct Page *pages;
+extern size_t npage;
+extern struct Pcache pcache[];
+extern struct Zpool zpool;
+extern struct Cachegeom l2geom;
+extern uint32_t ncolour;
+extern uint32_t tlb_invlpg_max;
+extern struct Tlbstats tlbstats;
+extern size_t node_npage[];
+
+void	i386_detect_memory(void);
+void	page_init(void);
+int	page_alloc_order(int order, struct Page **pp_store);
+int	page_alloc_node(int node, int order, int alloc_flags, struct Page **pp_store);
+void	page_free_order(struct Page *pp, int order);
+int	page_alloc(struct Page **pp_store, int alloc_flags);
+void	page_free(struct Page *pp);
+void	page_decref(struct Page *pp);
+size_t	page_free_blocks(int order);
+void	pcache_drain(struct Pcache *pc, uint32_t keep);
+int	page_zero_idle(void);
+void	page_zero_stop(void);
+int	page_alloc_colour(uint32_t colour, struct Page **pp_store);
+int	page_alloc_spread(struct Page **pp_store);
+
+pte_t	*pt_walk(uintptr_t va, int create);
+int	pt_map_range(uintptr_t va, physaddr_t pa, size_t size, pte_t perm);
+int	pt_unmap_range(uintptr_t va, size_t size);
+void	*mmio_map_region(physaddr_t pa, size_t size, int memtype);
+void	*kmap(struct Page *pp);
+void	kunmap(void *va);
+void	*kmap_block(struct Page *pp, int order);
+void	kunmap_block(void *va, int order);
+void	tlb_batch_add(struct Tlbbatch *tb, uintptr_t va, pte_t old);
+void	tlb_batch_finish(struct Tlbbatch *tb);
+
+static inline ppn_t
+page2ppn(struct Page *pp)
+{
+	return pp - pages;
+}
+
+static inline physaddr_t
+page2pa(struct Page *pp)
+{
+	return (physaddr_t) page2ppn(pp) << PGSHIFT;
+}
+
+static inline struct Page*
+pa2page(physaddr_t pa)
+{
+	if (PPN(pa) >= npage)
+		panic("pa2page called with invalid pa");
+	return &pages[PPN(pa)];
+}
+
+static inline int
+page2zone(struct Page *pp)
+{
+	return page2pa(pp) < MAXKPA ? ZONE_NORMAL : ZONE_HIGH;
+}
+
+static inline int
+page2node(struct Page *pp)
+{
+	return pp->pp_flags >> PP_NODESHIFT;
+}
+
+static inline uint32_t
+page2colour(struct Page *pp)
+{
+	return page2ppn(pp) & (ncolour - 1);
+}
+
+static inline void*
+page2kva(struct Page *pp)
+{
+	return KADDR(page2pa(pp));
+}
+
+#endif /* !JOS_KERN_PMAP_H */
@@ -0,0 +1,36 @@
+/* See COPYRIGHT for copyright information. */
+
+#include <inc/types.h>
+#include <inc/mmu.h>
+#include <inc/pool.h>
+
+#include <kern/pmap.h>
+#include <kern/pool.h>
+
+// Kernel support for the object pools of inc/pool.h: the list of pools
+// the monitor shows, and memory for them to grow with.
+
+// Registered pools, most recent first
+struct Poolstats *pool_list;
+
+// Have the monitor's "pools" command show the pool with stats 'ps'.
+void
+pool_register(struct Poolstats *ps)
+{
+	ps->ps_next = pool_list;
+	pool_list = ps;
+}
+
+// A grow function for kernel pools: a page at a time, from the page
+// allocator.  The pages stay with the pool for good.
+void *
+pool_page_grow(size_t *len)
+{
+	struct Page *pp;
+
+	if (page_alloc(&pp, 0) < 0)
+		return NULL;
+	pp->pp_ref++;
+	*len = PGSIZE;
+	return page2kva(pp);
+}
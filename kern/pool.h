@@ -0,0 +1,17 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_POOL_H
+#define JOS_KERN_POOL_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/pool.h>
+
+extern struct Poolstats *pool_list;
+
+void	pool_register(struct Poolstats *ps);
+void	*pool_page_grow(size_t *len);
+
+#endif /* !JOS_KERN_POOL_H */